@@ -0,0 +1,272 @@
+#include "AllocationTrace.h"
+#include "MemoryManager.h"
+#include "FileIO.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+using namespace std;
+
+static const char TRACE_MAGIC[8] = {'M', 'M', 'T', 'R', 'A', 'C', 'E', '1'};
+static const size_t TRACE_HEADER_SIZE = 16;
+static const size_t RECORDS_PER_BUFFER = 4096;     // 128 KiB per write
+static const size_t SPARE_BUFFERS = 16;            // emptied buffers kept for reuse
+
+static_assert(sizeof(TraceRecord) == 32, "trace records are 32 bytes on disk");
+
+// trace instance ids are never reused, so a thread's buffer for a closed trace can never match a new one
+static atomic<uint64_t> nextTraceId(1);
+
+thread_local AllocationTrace::LocalBuffers AllocationTrace::localBuffers;
+
+// small sequential id for the calling thread, assigned on its first traced call
+static uint32_t traceThreadId() {
+    static atomic<uint32_t> nextThreadId(0);
+    thread_local uint32_t threadId = nextThreadId++;
+    return threadId;
+}
+
+
+AllocationTrace::AllocationTrace() : fileDescriptor(-1), instanceId(0), stopping(false) {}
+
+AllocationTrace::~AllocationTrace() {
+    close();
+}
+
+// creates (or truncates) the trace file, writes its header and starts the writer thread
+bool AllocationTrace::open(const string &fileName, unsigned wordSize) {
+    close();
+
+    fileDescriptor = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fileDescriptor == -1) {
+        perror("Failed to open trace file");
+        return false;
+    }
+
+    char header[TRACE_HEADER_SIZE] = {};
+    memcpy(header, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    uint32_t size = wordSize;
+    memcpy(header + 8, &size, sizeof(size));
+    if (!writeAll(fileDescriptor, header, sizeof(header))) {
+        perror("Failed to write trace file");
+        ::close(fileDescriptor);
+        fileDescriptor = -1;
+        return false;
+    }
+
+    start = chrono::steady_clock::now();
+    instanceId = nextTraceId++;
+    stopping = false;
+    writer = thread(&AllocationTrace::writerLoop, this);
+    return true;
+}
+
+void AllocationTrace::record(uint8_t op, uint64_t size, uint64_t offset) {
+    TraceRecord entry = {};
+    entry.timestamp = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    entry.size = size;
+    entry.offset = offset;
+    entry.threadId = traceThreadId();
+    entry.op = op;
+
+    // Only a full buffer goes through the lock, to be handed to the writer in exchange for an emptied one.
+    // Buffers are recycled because a fresh 128 KiB one would be mapped and unmapped by malloc every time.
+    vector<TraceRecord> &records = threadBuffer().records;
+    records.push_back(entry);
+    if (records.size() >= RECORDS_PER_BUFFER) {
+        {
+            lock_guard<mutex> lock(bufferLock);
+            full.push_back(move(records));
+            records = vector<TraceRecord>();
+            if (!spare.empty()) {
+                records.swap(spare.back());
+                spare.pop_back();
+            }
+        }
+        buffersReady.notify_one();
+        records.reserve(RECORDS_PER_BUFFER);
+    }
+}
+
+// the calling thread's buffer for this trace, created on first use
+AllocationTrace::ThreadBuffer &AllocationTrace::threadBuffer() {
+    for (auto &entry : localBuffers) {
+        if (entry.first == instanceId) {
+            return *entry.second;
+        }
+    }
+
+    // Drop buffers of traces closed since this thread last looked
+    localBuffers.erase(remove_if(localBuffers.begin(), localBuffers.end(), [](const LocalBuffers::value_type &entry) {
+        return entry.second->closed.load(memory_order_relaxed);
+    }), localBuffers.end());
+
+    auto buffer = make_shared<ThreadBuffer>();
+    buffer->records.reserve(RECORDS_PER_BUFFER);
+    {
+        lock_guard<mutex> lock(bufferLock);
+        threadBuffers.push_back(buffer);
+    }
+    localBuffers.emplace_back(instanceId, buffer);
+    return *buffer;
+}
+
+// flushes everything recorded so far and closes the file
+void AllocationTrace::close() {
+    if (fileDescriptor == -1) {
+        return;
+    }
+
+    // No thread is recording any more, so their partial buffers can be taken as they are
+    {
+        lock_guard<mutex> lock(bufferLock);
+        for (auto &buffer : threadBuffers) {
+            if (!buffer->records.empty()) {
+                full.push_back(move(buffer->records));
+            }
+            buffer->closed.store(true, memory_order_relaxed);
+        }
+        threadBuffers.clear();
+        spare.clear();
+        stopping = true;
+    }
+    buffersReady.notify_one();
+    writer.join();
+
+    ::close(fileDescriptor);
+    fileDescriptor = -1;
+}
+
+void AllocationTrace::writerLoop() {
+    unique_lock<mutex> lock(bufferLock);
+    while (true) {
+        buffersReady.wait(lock, [this] { return stopping || !full.empty(); });
+        while (!full.empty()) {
+            vector<TraceRecord> buffer = move(full.front());
+            full.pop_front();
+
+            // the file write happens without the lock, so record() is never held up by I/O
+            lock.unlock();
+            if (!writeAll(fileDescriptor, buffer.data(), buffer.size() * sizeof(TraceRecord))) {
+                perror("Failed to write trace file");
+            }
+            buffer.clear();
+            lock.lock();
+            if (spare.size() < SPARE_BUFFERS) {
+                spare.push_back(move(buffer));
+            }
+        }
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+// loads a whole trace file
+bool AllocationTrace::read(const string &fileName, unsigned &wordSize, vector<TraceRecord> &records) {
+    int input = ::open(fileName.c_str(), O_RDONLY);
+    if (input == -1) {
+        return false;
+    }
+
+    char header[TRACE_HEADER_SIZE];
+    if (::read(input, header, sizeof(header)) != static_cast<ssize_t>(sizeof(header)) ||
+        memcmp(header, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+        ::close(input);
+        return false;
+    }
+    uint32_t size;
+    memcpy(&size, header + 8, sizeof(size));
+    wordSize = size;
+
+    off_t end = lseek(input, 0, SEEK_END);
+    size_t count = (end > static_cast<off_t>(TRACE_HEADER_SIZE)) ? (end - TRACE_HEADER_SIZE) / sizeof(TraceRecord) : 0;
+    records.resize(count);
+    bool complete = pread(input, records.data(), count * sizeof(TraceRecord), TRACE_HEADER_SIZE) ==
+                    static_cast<ssize_t>(count * sizeof(TraceRecord));
+    ::close(input);
+
+    // Threads' chunks are interleaved in the file; a stable sort keeps each thread's own order
+    stable_sort(records.begin(), records.end(), [](const TraceRecord &left, const TraceRecord &right) {
+        return left.timestamp < right.timestamp;
+    });
+    return complete;
+}
+
+// 1 - (largest hole / free words); 0 when all free space is one hole or the arena is down. Exact, unlike
+// ArenaStats::fragmentation, whose largest hole may lag with the address-ordered strategies.
+double externalFragmentation(MemoryManager &manager) {
+    uint64_t *list = static_cast<uint64_t *>(manager.getListWide());
+    if (list == nullptr) {
+        return 0;
+    }
+    uint64_t freeWords = 0;
+    uint64_t largestHole = 0;
+    for (uint64_t i = 0; i < list[0]; i++) {
+        freeWords += list[2 + 2 * i];
+        largestHole = max(largestHole, list[2 + 2 * i]);
+    }
+    delete[] list;
+    return (freeWords == 0) ? 0.0 : 1.0 - static_cast<double>(largestHole) / freeWords;
+}
+
+// feeds a recorded trace through a fresh MemoryManager using 'allocator'. Recorded offsets only name
+// blocks; the replay maps each one to whatever address the allocator under test returned for it.
+bool AllocationTrace::replay(const string &fileName, function<int(int, void *)> allocator, ReplayResult &result) {
+    unsigned wordSize;
+    vector<TraceRecord> records;
+    if (!read(fileName, wordSize, records)) {
+        return false;
+    }
+
+    MemoryManager manager(wordSize, move(allocator));
+    unordered_map<uint64_t, pair<void *, size_t>> blocks;     // recorded offset -> (address, words)
+    size_t sizeInWords = 0;
+    size_t wordsInUse = 0;
+    result = ReplayResult();
+
+    for (const TraceRecord &entry : records) {
+        auto begin = chrono::steady_clock::now();
+        if (entry.op == TRACE_INITIALIZE) {
+            ArenaOptions options;
+            options.wide = entry.size > 65536;
+            manager.initialize(entry.size, options);
+            sizeInWords = entry.size;
+            wordsInUse = 0;
+            blocks.clear();
+        } else if (entry.op == TRACE_ALLOCATE) {
+            void *address = manager.allocate(entry.size);
+            result.allocations++;
+            if (address == nullptr) {
+                result.failedAllocations++;
+            } else if (entry.offset != TRACE_FAILED) {
+                size_t words = max<size_t>(1, (entry.size + wordSize - 1) / wordSize);
+                blocks[entry.offset] = make_pair(address, words);
+                wordsInUse += words;
+            } else {
+                manager.free(address);      // did not exist in the recording, so nothing will free it
+            }
+        } else if (entry.op == TRACE_FREE) {
+            auto block = blocks.find(entry.offset);
+            if (block != blocks.end()) {
+                manager.free(block->second.first);
+                wordsInUse -= block->second.second;
+                blocks.erase(block);
+                result.frees++;
+            }
+        }
+        result.seconds += chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+        if (sizeInWords > 0) {
+            result.peakUtilization = max(result.peakUtilization, static_cast<double>(wordsInUse) / sizeInWords);
+        }
+    }
+
+    result.finalFragmentation = externalFragmentation(manager);
+    return true;
+}
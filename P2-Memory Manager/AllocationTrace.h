@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// trace file layout: a 16-byte header ("MMTRACE1", uint32_t word size, uint32_t reserved) followed by
+// 32-byte records, all little-endian. Each thread's records are written in chunks as its buffer fills, so
+// the file is in time order per thread only; read() merges the threads back together by timestamp.
+enum TraceOp : uint8_t {
+    TRACE_INITIALIZE = 0,   // size = arena size in words
+    TRACE_ALLOCATE = 1,     // size = bytes requested, offset = word offset returned (TRACE_FAILED if none)
+    TRACE_FREE = 2,         // offset = word offset of the freed block
+};
+
+static const uint64_t TRACE_FAILED = UINT64_MAX;
+
+struct TraceRecord {
+    uint64_t timestamp;     // nanoseconds since the trace was opened
+    uint64_t size;
+    uint64_t offset;
+    uint32_t threadId;      // small per-process thread number, in order of first traced call
+    uint8_t op;             // TraceOp
+    uint8_t reserved[3];
+};
+
+// what replaying a trace through one allocator produced
+struct ReplayResult {
+    size_t allocations = 0;
+    size_t failedAllocations = 0;    // failed in the replay (whether or not they failed when recorded)
+    size_t frees = 0;
+    double peakUtilization = 0;      // largest share of the arena's words in use at once
+    double finalFragmentation = 0;   // 1 - largest hole / free words, after the last record
+    double seconds = 0;              // time spent inside MemoryManager calls
+};
+
+class MemoryManager;
+double externalFragmentation(MemoryManager &manager);   // as ReplayResult::finalFragmentation, at any point
+
+// AllocationTrace
+// Every thread buffers its own trace records and hands full buffers to a background thread that writes
+// them out, so recording takes no lock (only a handoff every RECORDS_PER_BUFFER records) and no I/O on
+// the caller's thread. close() flushes every thread's partial buffer; it must not race with record().
+class AllocationTrace {
+public:
+    AllocationTrace();
+    ~AllocationTrace();
+    bool open(const std::string &fileName, unsigned wordSize);
+    void record(uint8_t op, uint64_t size, uint64_t offset);
+    void close();
+
+    static bool read(const std::string &fileName, unsigned &wordSize, std::vector<TraceRecord> &records);
+    static bool replay(const std::string &fileName, std::function<int(int, void *)> allocator, ReplayResult &result);
+
+private:
+    // one thread's records for one trace; shared with the thread so either can go first
+    struct ThreadBuffer {
+        std::vector<TraceRecord> records;
+        std::atomic<bool> closed{false};            // the trace was closed; the thread drops it on its next miss
+    };
+    using LocalBuffers = std::vector<std::pair<uint64_t, std::shared_ptr<ThreadBuffer>>>;
+
+    ThreadBuffer &threadBuffer();
+    void writerLoop();
+
+    int fileDescriptor;
+    uint64_t instanceId;                            // names this trace to the threads' buffer lists; new per open
+    std::chrono::steady_clock::time_point start;
+    std::mutex bufferLock;                          // guards threadBuffers, full, spare and stopping
+    std::condition_variable buffersReady;
+    std::vector<std::shared_ptr<ThreadBuffer>> threadBuffers;  // every thread's buffer, for close()
+    std::deque<std::vector<TraceRecord>> full;      // waiting for the writer
+    std::vector<std::vector<TraceRecord>> spare;    // written out and emptied, for record() to fill again
+    bool stopping;
+    std::thread writer;
+    static thread_local LocalBuffers localBuffers;  // calling thread's buffers, one per open trace
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include "MemoryManager.h"
+
+// ArenaAllocator
+// Standard library allocator over a MemoryManager arena, so containers can keep their storage there:
+//
+//   std::vector<int, ArenaAllocator<int>> values(ArenaAllocator<int>(manager));
+//
+// Storage comes from allocateAligned() with the element type's alignment. Like any standard allocator it
+// throws std::bad_alloc when the arena cannot satisfy a request. Copies (including rebound ones) share the
+// arena and compare equal. Containers must be destroyed before the arena is shut down.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(MemoryManager &manager) noexcept : arena(&manager) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) noexcept : arena(&other.manager()) {}
+
+    T *allocate(size_t count);
+    void deallocate(T *pointer, size_t) noexcept { arena->free(pointer); }
+    MemoryManager &manager() const noexcept { return *arena; }
+
+private:
+    MemoryManager *arena;
+};
+
+
+template <typename T>
+T *ArenaAllocator<T>::allocate(size_t count) {
+    if (count > SIZE_MAX / sizeof(T)) {
+        throw std::bad_array_new_length();
+    }
+    void *block = arena->allocateAligned(count * sizeof(T), alignof(T));
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    return static_cast<T *>(block);
+}
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &left, const ArenaAllocator<U> &right) noexcept {
+    return &left.manager() == &right.manager();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &left, const ArenaAllocator<U> &right) noexcept {
+    return !(left == right);
+}
@@ -0,0 +1,82 @@
+#include "ArenaFormats.h"
+#include "FileIO.h"
+#include <charconv>    // to_chars
+#include <cstdio>      // perror
+#include <cstring>     // memcpy
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+// The used-word bitmap already has the getBitmap layout in memory on little-endian machines, so it is copied
+// out wholesale (memcpy picks the widest vector moves the CPU supports); otherwise bytes are peeled off each
+// 64-bit word.
+unsigned char *newBitmap(const uint64_t *usedBits, size_t sizeInWords, size_t headerBytes) {
+    size_t bitmapSize = (sizeInWords + 7) / 8;
+    unsigned char *bitmap = new unsigned char[headerBytes + bitmapSize];
+    for (size_t i = 0; i < headerBytes; i++) {
+        bitmap[i] = static_cast<unsigned char>(static_cast<uint64_t>(bitmapSize) >> (8 * i));
+    }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(bitmap + headerBytes, usedBits, bitmapSize);
+#else
+    for (size_t i = 0; i < bitmapSize; i++) {
+        bitmap[headerBytes + i] = static_cast<unsigned char>(usedBits[i / 8] >> (8 * (i % 8)));
+    }
+#endif
+    return bitmap;
+}
+
+// The holes come straight from the hole index so wide arenas are dumped with their full offsets. They are
+// formatted into a fixed buffer rather than gathered into one string first. The buffer is written out
+// whenever less than a whole entry is left (at most 46 bytes: " - [" + 2 x 20 digits + ", " + "]") and each
+// number gets at most 20 digits, so every write stays inside it.
+int dumpHoles(const HoleIndex &holes, const char *fileName) {
+    // Open the file with read, write permissions; create if not exists; truncate if exists.
+    int fileDescriptor = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0777);
+    if (fileDescriptor == -1) {
+        perror("Failed to open file");
+        return -1;
+    }
+
+    const size_t MAX_DIGITS = 20;
+    const size_t MAX_ENTRY = 6 + 2 * MAX_DIGITS;
+    char buffer[65536];
+    char *const limit = buffer + sizeof(buffer);
+    char *end = buffer;
+    bool first = true;
+    for (const auto &hole : holes.holes()) {
+        if (static_cast<size_t>(limit - end) < MAX_ENTRY) {
+            if (!writeAll(fileDescriptor, buffer, end - buffer)) {
+                perror("Failed to write to file");
+                close(fileDescriptor);
+                return -1;
+            }
+            end = buffer;
+        }
+        if (!first) {
+            *end++ = ' ';
+            *end++ = '-';
+            *end++ = ' ';
+        }
+        first = false;
+        *end++ = '[';
+        end = to_chars(end, end + MAX_DIGITS, hole.first).ptr;
+        *end++ = ',';
+        *end++ = ' ';
+        end = to_chars(end, end + MAX_DIGITS, hole.second).ptr;
+        *end++ = ']';
+    }
+
+    // Write what is left of the formatted text to the file.
+    if (end > buffer && !writeAll(fileDescriptor, buffer, end - buffer)) {
+        perror("Failed to write to file");
+        close(fileDescriptor);
+        return -1;
+    }
+
+    close(fileDescriptor);
+    return 0;
+}
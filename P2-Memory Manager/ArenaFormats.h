@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "HoleIndex.h"
+
+// ArenaFormats
+// The free list, bitmap and memory map formats MemoryManager and BasicMemoryManager hand out, built from
+// the two structures both keep up to date: the HoleIndex and the used-word bitmap (a bit per word, least
+// significant first, set while the word is allocated). Changes to a format are made here, once.
+
+static const size_t LEGACY_MAX_WORDS = 65536;      // largest arena the 16-bit list format can describe
+
+// bytes of the used-word bitmap for an arena of the given size (whole uint64_t words)
+inline size_t usedBitsBytes(size_t sizeInWords) {
+    return (sizeInWords + 63) / 64 * sizeof(uint64_t);
+}
+
+// sets (used = true) or clears the bits of words [first, first + count), 64 words per store
+inline void markUsedBits(uint64_t *usedBits, size_t first, size_t count, bool used) {
+    if (count == 0) {
+        return;
+    }
+
+    size_t last = first + count - 1;
+    size_t firstWord = first / 64;
+    size_t lastWord = last / 64;
+    uint64_t headMask = ~static_cast<uint64_t>(0) << (first % 64);
+    uint64_t tailMask = ~static_cast<uint64_t>(0) >> (63 - last % 64);
+
+    if (firstWord == lastWord) {
+        headMask &= tailMask;
+    }
+    usedBits[firstWord] = used ? (usedBits[firstWord] | headMask) : (usedBits[firstWord] & ~headMask);
+    if (firstWord == lastWord) {
+        return;
+    }
+
+    for (size_t word = firstWord + 1; word < lastWord; word++) {
+        usedBits[word] = used ? ~static_cast<uint64_t>(0) : 0;
+    }
+    usedBits[lastWord] = used ? (usedBits[lastWord] | tailMask) : (usedBits[lastWord] & ~tailMask);
+}
+
+// writes the [count, start, length, ...] free list into 'list', which has room for 1 + 2 * holeCount()
+// entries; Entry is uint16_t for the legacy list and uint64_t for the wide one
+template <typename Entry>
+void writeFreeList(const HoleIndex &holes, Entry *list) {
+    *list++ = static_cast<Entry>(holes.holeCount());
+    for (const auto &hole : holes.holes()) {
+        *list++ = static_cast<Entry>(hole.first);     // Start index.
+        *list++ = static_cast<Entry>(hole.second);    // Length.
+    }
+}
+
+// getBitmap formats: a headerBytes-long little-endian byte count (2 legacy, 8 wide), then the bitmap bytes;
+// bit j of byte i is word i * 8 + j. Allocated with new[].
+unsigned char *newBitmap(const uint64_t *usedBits, size_t sizeInWords, size_t headerBytes);
+
+// writes the holes as "[start, length] - [start, length] ..." to fileName; 0 on success, -1 on failure
+int dumpHoles(const HoleIndex &holes, const char *fileName);
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <sys/mman.h>
+#include "ArenaFormats.h"
+#include "HoleIndex.h"
+
+// fit policies for BasicMemoryManager. Each picks a hole straight from the HoleIndex, making the same
+// choice as the fit function of the same name, and says which HoleIndex orderings it needs kept up.
+struct BestFitPolicy {
+    static const bool sizeOrdered = true;
+    static const bool sizeClasses = false;
+    static size_t find(const HoleIndex &holes, size_t words, size_t &) { return holes.findBest(words); }
+};
+
+struct WorstFitPolicy {
+    static const bool sizeOrdered = true;
+    static const bool sizeClasses = false;
+    static size_t find(const HoleIndex &holes, size_t words, size_t &) { return holes.findWorst(words); }
+};
+
+struct FirstFitPolicy {
+    static const bool sizeOrdered = false;
+    static const bool sizeClasses = false;
+    static size_t find(const HoleIndex &holes, size_t words, size_t &) { return holes.findFirst(words); }
+};
+
+// resumes where the previous allocation ended
+struct NextFitPolicy {
+    static const bool sizeOrdered = false;
+    static const bool sizeClasses = false;
+    static size_t find(const HoleIndex &holes, size_t words, size_t &cursor) {
+        size_t start = holes.findNext(words, cursor);
+        if (start != HoleIndex::npos) {
+            cursor = start + words;
+        }
+        return start;
+    }
+};
+
+struct SegregatedFitPolicy {
+    static const bool sizeOrdered = false;
+    static const bool sizeClasses = true;
+    static size_t find(const HoleIndex &holes, size_t words, size_t &) { return holes.findSegregated(words); }
+};
+
+// BasicMemoryManager
+// MemoryManager with the fit policy and word size fixed at compile time. allocate() calls the policy
+// directly instead of going through std::function and a rebuilt free list, so the search inlines, and
+// byte/word conversions divide by a constant. getList(), getBitmap() and dumpMemoryMap() share their code
+// with MemoryManager (ArenaFormats.h), over the same hole index and used-word bitmap. Arenas may hold up to 2^32 - 1 words; getList()/getBitmap() return nullptr
+// beyond 65536 like MemoryManager's legacy versions. Not thread-safe. MemoryManager stays the runtime-
+// configurable front end (custom allocators, wide/concurrent/buddy arenas, tracing).
+template <typename Policy, unsigned WordSize>
+class BasicMemoryManager {
+    static_assert(WordSize > 0, "word size must be positive");
+
+public:
+    BasicMemoryManager();
+    ~BasicMemoryManager();
+    BasicMemoryManager(const BasicMemoryManager &) = delete;
+    BasicMemoryManager &operator=(const BasicMemoryManager &) = delete;
+
+    void initialize(size_t sizeInWords);
+    void shutdown();
+    void *allocate(size_t sizeInBytes);
+    void free(void *address);
+    int dumpMemoryMap(char *fileName);
+    void *getList();
+    void *getBitmap();
+    unsigned getWordSize();
+    void *getMemoryStart();
+    unsigned getMemoryLimit();
+
+private:
+    static const size_t MAX_WORDS = UINT32_MAX;        // block lengths are tracked as uint32_t
+
+    char *memoryStart;
+    size_t sizeInWords;
+    uint32_t *memoryTracker;                           // length of the block starting at each word, 0 if none
+    uint64_t *usedBits;                                // bit per word, set while allocated (for getBitmap)
+    HoleIndex freeHoles;
+    size_t cursor;                                     // where the policy resumes (next fit only)
+};
+
+
+template <typename Policy, unsigned WordSize>
+BasicMemoryManager<Policy, WordSize>::BasicMemoryManager()
+    : memoryStart(nullptr), sizeInWords(0), memoryTracker(nullptr), usedBits(nullptr), cursor(0) {
+    freeHoles.trackSizes(Policy::sizeOrdered);
+    freeHoles.trackSizeClasses(Policy::sizeClasses);
+}
+
+template <typename Policy, unsigned WordSize>
+BasicMemoryManager<Policy, WordSize>::~BasicMemoryManager() {
+    shutdown();
+}
+
+// maps an arena of requestedSize words (and its tracker and bitmap); anonymous mappings come zeroed
+template <typename Policy, unsigned WordSize>
+void BasicMemoryManager<Policy, WordSize>::initialize(size_t requestedSize) {
+    if (requestedSize > MAX_WORDS) {
+        std::cerr << "Error: Memory size exceeds " << MAX_WORDS << " words." << std::endl;
+        return;
+    }
+    shutdown();
+
+    void *arena = mmap(nullptr, requestedSize * WordSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void *tracker = mmap(nullptr, requestedSize * sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void *bits = mmap(nullptr, usedBitsBytes(requestedSize), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED || tracker == MAP_FAILED || bits == MAP_FAILED) {
+        std::cerr << "Error: Memory allocation failed." << std::endl;
+        if (arena != MAP_FAILED) {
+            munmap(arena, requestedSize * WordSize);
+        }
+        if (tracker != MAP_FAILED) {
+            munmap(tracker, requestedSize * sizeof(uint32_t));
+        }
+        if (bits != MAP_FAILED) {
+            munmap(bits, usedBitsBytes(requestedSize));
+        }
+        return;
+    }
+
+    memoryStart = static_cast<char *>(arena);
+    sizeInWords = requestedSize;
+    memoryTracker = static_cast<uint32_t *>(tracker);
+    usedBits = static_cast<uint64_t *>(bits);
+    cursor = 0;
+    freeHoles.reset(requestedSize);
+}
+
+template <typename Policy, unsigned WordSize>
+void BasicMemoryManager<Policy, WordSize>::shutdown() {
+    if (memoryStart != nullptr) {
+        munmap(memoryStart, sizeInWords * WordSize);
+        munmap(memoryTracker, sizeInWords * sizeof(uint32_t));
+        munmap(usedBits, usedBitsBytes(sizeInWords));
+    }
+    memoryStart = nullptr;
+    memoryTracker = nullptr;
+    usedBits = nullptr;
+    freeHoles.clear();
+}
+
+template <typename Policy, unsigned WordSize>
+void *BasicMemoryManager<Policy, WordSize>::allocate(size_t sizeInBytes) {
+    if (memoryStart == nullptr || sizeInBytes > sizeInWords * WordSize) {
+        return nullptr;
+    }
+
+    // a zero-byte request still gets a word, as in MemoryManager
+    size_t requiredWords = std::max<size_t>(1, (sizeInBytes + WordSize - 1) / WordSize);
+    size_t allocationStart = Policy::find(freeHoles, requiredWords, cursor);
+    if (allocationStart == HoleIndex::npos || !freeHoles.carve(allocationStart, requiredWords)) {
+        return nullptr;
+    }
+    markUsedBits(usedBits, allocationStart, requiredWords, true);
+    memoryTracker[allocationStart] = static_cast<uint32_t>(requiredWords);
+    return memoryStart + allocationStart * WordSize;
+}
+
+template <typename Policy, unsigned WordSize>
+void BasicMemoryManager<Policy, WordSize>::free(void *address) {
+    if (memoryStart == nullptr || address == nullptr) {
+        return;
+    }
+
+    // Ignore addresses outside the arena, off a word boundary, or not at the start of a live block
+    ptrdiff_t offset = static_cast<char *>(address) - memoryStart;
+    if (offset < 0 || offset % WordSize != 0 || static_cast<size_t>(offset / WordSize) >= sizeInWords) {
+        return;
+    }
+    size_t blockStart = offset / WordSize;
+    if (memoryTracker[blockStart] == 0) {
+        return;
+    }
+
+    markUsedBits(usedBits, blockStart, memoryTracker[blockStart], false);
+    freeHoles.release(blockStart, memoryTracker[blockStart]);
+    memoryTracker[blockStart] = 0;
+}
+
+// same text format as MemoryManager::dumpMemoryMap: "[start, length] - [start, length] ..."
+template <typename Policy, unsigned WordSize>
+int BasicMemoryManager<Policy, WordSize>::dumpMemoryMap(char *fileName) {
+    if (memoryStart == nullptr) {
+        return -1;
+    }
+    return dumpHoles(freeHoles, fileName);
+}
+
+// [count, start, length, ...] in uint16_t, like MemoryManager::getList
+template <typename Policy, unsigned WordSize>
+void *BasicMemoryManager<Policy, WordSize>::getList() {
+    if (memoryStart == nullptr || sizeInWords > LEGACY_MAX_WORDS) {
+        return nullptr;
+    }
+
+    uint16_t *list = new uint16_t[1 + 2 * freeHoles.holeCount()];
+    writeFreeList(freeHoles, list);
+    return list;
+}
+
+// 2-byte little-endian size, then one bit per word (LSB first), set while allocated, like MemoryManager::getBitmap
+template <typename Policy, unsigned WordSize>
+void *BasicMemoryManager<Policy, WordSize>::getBitmap() {
+    if (memoryStart == nullptr || sizeInWords > LEGACY_MAX_WORDS) {
+        return nullptr;
+    }
+    return newBitmap(usedBits, sizeInWords, 2);
+}
+
+template <typename Policy, unsigned WordSize>
+unsigned BasicMemoryManager<Policy, WordSize>::getWordSize() {
+    return WordSize;
+}
+
+template <typename Policy, unsigned WordSize>
+void *BasicMemoryManager<Policy, WordSize>::getMemoryStart() {
+    return memoryStart;
+}
+
+template <typename Policy, unsigned WordSize>
+unsigned BasicMemoryManager<Policy, WordSize>::getMemoryLimit() {
+    return sizeInWords * WordSize;
+}
@@ -0,0 +1,103 @@
+#include "BuddyAllocator.h"
+#include <set>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+
+BuddyAllocator::BuddyAllocator() : freeBlocks(MAX_ORDERS), nonEmptyOrders(0) {
+}
+
+void BuddyAllocator::reset(size_t sizeInWords) {
+    clear();
+    extend(0, sizeInWords);
+}
+
+// splits the new words into the largest blocks that are aligned to their own length and releases them,
+// so they merge with free buddies below oldSize
+void BuddyAllocator::extend(size_t oldSize, size_t newSize) {
+    size_t start = oldSize;
+    while (start < newSize) {
+        size_t order = 63 - __builtin_clzll(newSize - start);
+        if (start != 0) {
+            order = min<size_t>(order, __builtin_ctzll(start));
+        }
+        release(start, static_cast<size_t>(1) << order);
+        start += static_cast<size_t>(1) << order;
+    }
+}
+
+void BuddyAllocator::clear() {
+    for (auto &order : freeBlocks) {
+        order.clear();
+    }
+    nonEmptyOrders = 0;
+}
+
+// takes the lowest-addressed block of the smallest non-empty order that is large enough, and splits it
+// in halves until it is blockWords long; the upper half of every split goes back on its free list
+size_t BuddyAllocator::allocate(size_t blockWords) {
+    if (blockWords == 0 || (blockWords & (blockWords - 1)) != 0) {
+        return npos;
+    }
+
+    size_t order = orderOf(blockWords);
+    uint64_t candidates = nonEmptyOrders & (~static_cast<uint64_t>(0) << order);
+    if (candidates == 0) {
+        return npos;
+    }
+
+    size_t found = __builtin_ctzll(candidates);
+    size_t start = *freeBlocks[found].begin();
+    removeBlock(start, found);
+    while (found > order) {
+        found--;
+        addBlock(start + (static_cast<size_t>(1) << found), found);
+    }
+    return start;
+}
+
+// merges the block with its buddy for as long as the buddy is free as a whole, then files the result
+void BuddyAllocator::release(size_t start, size_t blockWords) {
+    if (blockWords == 0) {
+        return;
+    }
+
+    size_t order = orderOf(blockWords);
+    while (order + 1 < MAX_ORDERS) {
+        size_t buddy = start ^ (static_cast<size_t>(1) << order);
+        if (!removeBlock(buddy, order)) {
+            break;
+        }
+        start = min(start, buddy);
+        order++;
+    }
+    addBlock(start, order);
+}
+
+size_t BuddyAllocator::blockWordsFor(size_t words) {
+    if (words <= 1) {
+        return words;
+    }
+    return static_cast<size_t>(1) << (64 - __builtin_clzll(words - 1));
+}
+
+size_t BuddyAllocator::orderOf(size_t blockWords) {
+    return __builtin_ctzll(blockWords);
+}
+
+void BuddyAllocator::addBlock(size_t start, size_t order) {
+    freeBlocks[order].insert(start);
+    nonEmptyOrders |= static_cast<uint64_t>(1) << order;
+}
+
+bool BuddyAllocator::removeBlock(size_t start, size_t order) {
+    if (freeBlocks[order].erase(start) == 0) {
+        return false;
+    }
+    if (freeBlocks[order].empty()) {
+        nonEmptyOrders &= ~(static_cast<uint64_t>(1) << order);
+    }
+    return true;
+}
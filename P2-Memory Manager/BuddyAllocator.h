@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <vector>
+
+// BuddyAllocator
+// binary buddy system over an arena of words. Every block is 2^k words long (order k) and starts at a
+// multiple of its length, so its buddy is the block at (start ^ 2^k). Each order has its own free list;
+// allocation splits the smallest large-enough block down to size and release merges a block with its
+// free buddy, order by order. An arena that is not a power of two is covered by the largest aligned
+// blocks that fit, which never merge past the end of the arena.
+class BuddyAllocator {
+public:
+    static const size_t npos = SIZE_MAX;
+
+    BuddyAllocator();
+    void reset(size_t sizeInWords);                // every word free
+    void clear();
+    void extend(size_t oldSize, size_t newSize);   // words [oldSize, newSize) join the arena, all free
+    size_t allocate(size_t blockWords);            // blockWords must be a power of two; returns the start or npos
+    void release(size_t start, size_t blockWords); // give back a block handed out by allocate
+    static size_t blockWordsFor(size_t words);     // smallest power of two >= words (0 stays 0)
+
+private:
+    static const size_t MAX_ORDERS = 64;           // one bit per order in nonEmptyOrders
+
+    static size_t orderOf(size_t blockWords);
+    void addBlock(size_t start, size_t order);
+    bool removeBlock(size_t start, size_t order);  // false if no free block of that order starts there
+
+    std::vector<std::set<size_t>> freeBlocks;      // start of every free block, by order
+    uint64_t nonEmptyOrders;                       // bit k set when freeBlocks[k] has a block
+};
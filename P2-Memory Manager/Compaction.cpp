@@ -0,0 +1,73 @@
+#include "MemoryManager.h"
+#include <chrono>
+
+using namespace std;
+
+// Compaction
+// Slides live blocks toward the start of the arena until all free space is a single hole at the end.
+// Each step takes the lowest hole and moves the block right after it down into it, which merges the hole
+// with the next one; a block moves at most once per pass. Every move is reported to the relocation
+// callback. A pass can be spread over several calls, each bounded by a time budget, and resumes where
+// the previous one stopped. Blocks that are allocated but not handed out (parked in a thread cache, or the
+// guard regions of debug mode) stay put, and compaction continues past them. The quarantine is released
+// first.
+
+
+// registers the function told about every block compact() moves; it runs with the arena locked and must
+// not call back into the manager
+void MemoryManager::setRelocationCallback(RelocationCallback callback) {
+    auto lock = lockArena();
+    relocationCallback = move(callback);
+}
+
+// moves blocks for up to 'budget' (at least one move per call) and returns true once the pass has reached
+// the end of the arena; blocks freed behind an unfinished pass leave holes for the next one. Blocks must
+// not be in use while compact runs, and their owners switch to the new addresses in the callback. Buddy
+// arenas are left alone, since moving a block would break its buddy alignment, and so are shared ones,
+// whose other processes are not told about moves.
+bool MemoryManager::compact(chrono::microseconds budget) {
+    auto lock = lockArena();
+    if (memoryStart == nullptr || buddy || sharedHeader != nullptr) {
+        return true;
+    }
+    flushQuarantine();
+
+    bool timed = budget != chrono::microseconds::max();
+    auto deadline = timed ? chrono::steady_clock::now() + budget : chrono::steady_clock::time_point::max();
+    const auto &holes = freeHoles.holes();
+    while (true) {
+        // Resume at the hole holding the cursor (a free since the last call may have extended it
+        // backwards) or the next one. Holes are coalesced, so the word after one is the end or a block.
+        auto hole = holes.upper_bound(compactCursor);
+        if (hole != holes.begin() && prev(hole)->first + prev(hole)->second > compactCursor) {
+            hole = prev(hole);
+        }
+        if (hole == holes.end() || hole->first + hole->second >= sizeInWords) {
+            break;
+        }
+        size_t blockStart = hole->first + hole->second;
+        size_t blockWords = memoryTracker[blockStart];
+        if ((concurrent && liveBlocks[blockStart].load(memory_order_relaxed) == 0) || isGuardRegion(blockStart)) {
+            compactCursor = blockStart + blockWords;
+            continue;
+        }
+
+        size_t newStart = slideIntoNeighbours(blockStart, blockWords);
+        traceResize(blockStart, newStart, blockWords * wordSize);
+        if (relocationCallback) {
+            char *base = static_cast<char *>(memoryStart);
+            relocationCallback(base + blockStart * wordSize, base + newStart * wordSize, blockWords * wordSize);
+        }
+        compactCursor = newStart + blockWords;
+        if (timed && chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+    }
+
+    compactCursor = 0;
+    freeListCurrent = false;
+    if (sizeInWords > initialWords) {
+        shrinkArena();
+    }
+    return true;
+}
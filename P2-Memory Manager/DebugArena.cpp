@@ -0,0 +1,165 @@
+#include "MemoryManager.h"
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include <sys/mman.h>  // mprotect
+
+using namespace std;
+
+// Debug mode
+// With debugSampling = N, about one block in N is watched, so the cost can be kept low enough for
+// production. A sampled free does not go back to the arena: the block is filled with a poison byte and
+// waits in a FIFO quarantine until more than quarantineWords words are waiting, and only then is the
+// poison checked and the block released; any byte that changed means the block was written after it was
+// freed. With guardPages, a sampled allocation of at least a page is placed on a page boundary between two
+// PROT_NONE pages, so running off either end faults at once; the slack between the block's end and its last
+// page is poisoned and checked when it is freed, and while it is quarantined the whole block is PROT_NONE,
+// so reads after free fault too. Guard pages are not used in buddy arenas. Errors are reported on stderr
+// and counted in ArenaStats::debugErrors. Concurrent arenas bypass their thread caches while debugging,
+// so every free reaches the sampler. On an explicit huge page arena the guard "pages" are whole huge pages,
+// since a hugetlb mapping cannot be protected in smaller pieces. Quarantined blocks count as in use; compact() and saveSnapshot()
+// release them first.
+
+static const unsigned char POISON = 0xDB;
+
+// all 'length' bytes hold the poison byte: the first does, and every byte equals the one after it
+static bool isPoisoned(const unsigned char *bytes, size_t length) {
+    return length == 0 || (bytes[0] == POISON && memcmp(bytes, bytes + 1, length - 1) == 0);
+}
+
+
+// true for about one call in debug->sampling. Each countdown restarts at a random length that averages the
+// sampling rate, so a workload that repeats with the same period is not always sampled at the same point.
+bool MemoryManager::sampleDebug(uint64_t &countdown) {
+    if (--countdown > 0) {
+        return false;
+    }
+    uint64_t &random = debug->random;
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+    countdown = 1 + random % (2 * static_cast<uint64_t>(debug->sampling) - 1);
+    return true;
+}
+
+// called by allocateWords while debugging: if guard pages are on, the block is at least a page and it is
+// sampled, allocates it starting on a page boundary, between a guard region that ends with a whole page
+// before it and one that takes the slack after it plus a whole page. Returns its start, or npos for the
+// block to be allocated as usual. The guard regions are blocks of their own in the tracker, so the block
+// itself can be freed as usual.
+size_t MemoryManager::allocateGuarded(size_t requiredWords) {
+    size_t pageSize = debug->pageSize;
+    size_t period;
+    size_t residue;
+    if (!debug->guardPages || requiredWords * wordSize < pageSize || !sampleDebug(debug->allocationCountdown) ||
+        !alignmentOf(pageSize, period, residue)) {
+        return HoleIndex::npos;
+    }
+
+    size_t blockBytes = (requiredWords * wordSize + pageSize - 1) / pageSize * pageSize;
+    size_t beforeWords = (pageSize + wordSize - 1) / wordSize;
+    size_t afterWords = (blockBytes + pageSize - requiredWords * wordSize + wordSize - 1) / wordSize;
+    size_t regionStart = allocateAlignedWords(beforeWords + requiredWords + afterWords, period,
+                                              (residue + period - beforeWords % period) % period);
+    if (regionStart == HoleIndex::npos) {
+        return HoleIndex::npos;
+    }
+
+    size_t blockStart = regionStart + beforeWords;
+    size_t afterStart = blockStart + requiredWords;
+    memoryTracker[regionStart] = static_cast<uint32_t>(beforeWords);
+    memoryTracker[blockStart] = static_cast<uint32_t>(requiredWords);
+    memoryTracker[afterStart] = static_cast<uint32_t>(afterWords);
+    debug->guardedBlocks[blockStart] = {regionStart, afterStart, afterWords};
+    debug->guardOwners[regionStart] = blockStart;
+    debug->guardOwners[afterStart] = blockStart;
+
+    char *block = static_cast<char *>(memoryStart) + blockStart * wordSize;
+    memset(block + requiredWords * wordSize, POISON, blockBytes - requiredWords * wordSize);
+    mprotect(block - pageSize, pageSize, PROT_NONE);
+    mprotect(block + blockBytes, pageSize, PROT_NONE);
+    return blockStart;
+}
+
+// called by freeWords while debugging: takes sampled blocks (and every guarded one) into quarantine and
+// returns true, or returns false for the block to be released as usual. Guard regions are never handed out,
+// so freeing one is ignored. A quarantined block has no tracker entry, so freeing it again is ignored too.
+bool MemoryManager::quarantineBlock(size_t blockStart) {
+    if (debug->guardOwners.count(blockStart) != 0) {
+        return true;
+    }
+    auto guarded = debug->guardedBlocks.find(blockStart);
+    if (guarded == debug->guardedBlocks.end() && !sampleDebug(debug->freeCountdown)) {
+        return false;
+    }
+
+    size_t blockWords = memoryTracker[blockStart];
+    memoryTracker[blockStart] = 0;
+    char *block = static_cast<char *>(memoryStart) + blockStart * wordSize;
+    if (guarded != debug->guardedBlocks.end()) {
+        size_t blockBytes = blockWords * wordSize;
+        size_t pageBytes = (blockBytes + debug->pageSize - 1) / debug->pageSize * debug->pageSize;
+        if (!isPoisoned(reinterpret_cast<unsigned char *>(block) + blockBytes, pageBytes - blockBytes)) {
+            reportCorruption(blockStart, "written past its end");
+        }
+        mprotect(block, pageBytes, PROT_NONE);
+    } else {
+        memset(block, POISON, blockWords * wordSize);
+    }
+
+    debug->quarantine.push_back({blockStart, blockWords});
+    debug->quarantinedWords += blockWords;
+    while (debug->quarantinedWords > debug->quarantineLimit) {
+        releaseQuarantined();
+    }
+    return true;
+}
+
+// checks the oldest quarantined block and gives it (with its guard regions) back to the arena
+void MemoryManager::releaseQuarantined() {
+    QuarantinedBlock oldest = debug->quarantine.front();
+    debug->quarantine.pop_front();
+    debug->quarantinedWords -= oldest.words;
+    char *base = static_cast<char *>(memoryStart);
+
+    auto guarded = debug->guardedBlocks.find(oldest.start);
+    if (guarded == debug->guardedBlocks.end()) {
+        if (!isPoisoned(reinterpret_cast<unsigned char *>(base) + oldest.start * wordSize, oldest.words * wordSize)) {
+            reportCorruption(oldest.start, "written after it was freed");
+        }
+        releaseWords(oldest.start, oldest.words);
+        if (buddy) {
+            buddyBlocks.release(oldest.start, oldest.words);
+        }
+        return;
+    }
+
+    // the block was PROT_NONE the whole time, so there is nothing to check; the guard pages and the block's
+    // pages are one run
+    GuardedBlock regions = guarded->second;
+    size_t pageSize = debug->pageSize;
+    size_t blockBytes = (oldest.words * wordSize + pageSize - 1) / pageSize * pageSize;
+    mprotect(base + oldest.start * wordSize - pageSize, blockBytes + 2 * pageSize, PROT_READ | PROT_WRITE);
+    memoryTracker[regions.beforeStart] = 0;
+    memoryTracker[regions.afterStart] = 0;
+    debug->guardOwners.erase(regions.beforeStart);
+    debug->guardOwners.erase(regions.afterStart);
+    debug->guardedBlocks.erase(guarded);
+    releaseWords(regions.beforeStart, regions.afterStart + regions.afterWords - regions.beforeStart);
+}
+
+// releases everything in quarantine, checking each block
+void MemoryManager::flushQuarantine() {
+    while (debug != nullptr && !debug->quarantine.empty()) {
+        releaseQuarantined();
+    }
+}
+
+bool MemoryManager::isGuardRegion(size_t start) {
+    return debug != nullptr && debug->guardOwners.count(start) != 0;
+}
+
+void MemoryManager::reportCorruption(size_t blockStart, const char *what) {
+    stats.debugErrors.fetch_add(1, memory_order_relaxed);
+    cerr << "Error: the block at word " << blockStart << " was " << what << "." << endl;
+}
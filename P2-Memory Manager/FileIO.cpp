@@ -0,0 +1,20 @@
+#include "FileIO.h"
+#include <cerrno>
+#include <unistd.h>
+
+// shared by every writer in the library (memory maps, traces), so they all survive short writes the same way
+bool writeAll(int fileDescriptor, const void *data, size_t length) {
+    const char *bytes = static_cast<const char *>(data);
+    while (length > 0) {
+        ssize_t written = write(fileDescriptor, bytes, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        length -= written;
+    }
+    return true;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstddef>
+
+// write() until all 'length' bytes are out, resuming after short writes and interrupted calls; false on error
+bool writeAll(int fileDescriptor, const void *data, size_t length);
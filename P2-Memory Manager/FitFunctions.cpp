@@ -95,4 +95,171 @@ int worstFit(int sizeInWords, void *list) {
 
     // Return the starting address of the largest hole (worst-fit)
     return memInfo[1 + 2 * largestHoleIndex];
-}
\ No newline at end of file
+}
+
+// setAllocator sets the allocator to use firstFit function
+// the list is in address order, so the first hole that fits is the lowest-addressed one and the search
+// stops there instead of looking at every hole
+int firstFit(int sizeInWords, void *list) {
+    uint16_t *memInfo = (uint16_t *)list;
+
+    for (int currentIndex = 0; currentIndex < memInfo[0]; currentIndex++) {
+        if (memInfo[2 + currentIndex * 2] >= sizeInWords) {
+            return memInfo[1 + currentIndex * 2];
+        }
+    }
+    return -1;
+}
+
+// where nextFit resumes: the word after the block it chose last. The cursor is shared by every caller;
+// MemoryManager recognizes nextFit and keeps a cursor per arena instead.
+static int nextFitCursor = 0;
+
+// setAllocator sets the allocator to use nextFit function
+// first fit that starts at the hole holding (or else following) the end of the previous choice and wraps
+// around to the start of the list, so successive blocks are laid out one after another (roving pointer)
+int nextFit(int sizeInWords, void *list) {
+    uint16_t *memInfo = (uint16_t *)list;
+    int numHoles = memInfo[0];
+
+    // First hole that ends after the cursor
+    int resumeIndex = 0;
+    while (resumeIndex < numHoles && memInfo[1 + resumeIndex * 2] + memInfo[2 + resumeIndex * 2] <= nextFitCursor) {
+        resumeIndex++;
+    }
+
+    for (int step = 0; step < numHoles; step++) {
+        int currentIndex = (resumeIndex + step) % numHoles;
+        if (memInfo[2 + currentIndex * 2] >= sizeInWords) {
+            nextFitCursor = memInfo[1 + currentIndex * 2] + sizeInWords;
+            return memInfo[1 + currentIndex * 2];
+        }
+    }
+    return -1;
+}
+
+// size class of a hole or request: class k covers [2^k, 2^(k+1)) words
+static int sizeClassOf(int sizeInWords) {
+    return 31 - __builtin_clz(static_cast<unsigned>(sizeInWords));
+}
+
+// setAllocator sets the allocator to use segregatedFit function
+// holes are grouped into power-of-two size classes; the request is rounded up to the next class so any
+// hole there fits, and the lowest-addressed hole of the smallest such class is chosen. Only if every
+// larger class is empty is the request's own class searched for a hole that is big enough.
+// MemoryManager recognizes this function and answers from its own size-class bins instead of the list.
+int segregatedFit(int sizeInWords, void *list) {
+    uint16_t *memInfo = (uint16_t *)list;
+
+    // Check if there are no available memory holes
+    if (memInfo[0] == 0 || sizeInWords <= 0) {
+        return -1;
+    }
+
+    int requestClass = sizeClassOf(sizeInWords);
+    bool exactClass = (sizeInWords & (sizeInWords - 1)) == 0;
+    int firstClass = exactClass ? requestClass : requestClass + 1;
+
+    // Smallest class at or above firstClass; the first hole seen in a class is the lowest-addressed one
+    int bestIndex = -1;
+    int bestClass = 0;
+    for (int currentIndex = 0; currentIndex < memInfo[0]; currentIndex++) {
+        uint16_t currentHoleSize = memInfo[2 + currentIndex * 2];
+        if (currentHoleSize == 0) {
+            continue;
+        }
+        int currentClass = sizeClassOf(currentHoleSize);
+        if (currentClass >= firstClass && (bestIndex == -1 || currentClass < bestClass)) {
+            bestIndex = currentIndex;
+            bestClass = currentClass;
+        }
+    }
+    if (bestIndex != -1) {
+        return memInfo[1 + bestIndex * 2];
+    }
+
+    // Fall back to the first hole in the request's own class that is large enough
+    for (int currentIndex = 0; currentIndex < memInfo[0]; currentIndex++) {
+        if (memInfo[2 + currentIndex * 2] >= sizeInWords) {
+            return memInfo[1 + currentIndex * 2];
+        }
+    }
+    return -1;
+}
+
+// wide bestFit: same search as bestFit over a uint64_t [count, start, length, ...] list
+int64_t bestFitWide(size_t sizeInWords, void *list) {
+    uint64_t *memInfo = (uint64_t *)list;
+
+    int64_t bestIndex = -1;
+    uint64_t smallestHoleSize = UINT64_MAX;
+    for (uint64_t currentIndex = 0; currentIndex < memInfo[0]; currentIndex++) {
+        uint64_t currentHoleSize = memInfo[2 + currentIndex * 2];
+        if (currentHoleSize >= sizeInWords && (bestIndex == -1 || currentHoleSize < smallestHoleSize)) {
+            bestIndex = currentIndex;
+            smallestHoleSize = currentHoleSize;
+        }
+    }
+
+    return (bestIndex == -1) ? -1 : static_cast<int64_t>(memInfo[1 + bestIndex * 2]);
+}
+
+// wide worstFit: same search as worstFit over a uint64_t [count, start, length, ...] list
+int64_t worstFitWide(size_t sizeInWords, void *list) {
+    uint64_t *memInfo = (uint64_t *)list;
+
+    int64_t largestHoleIndex = -1;
+    uint64_t largestHoleSize = 0;
+    for (uint64_t currentIndex = 0; currentIndex < memInfo[0]; currentIndex++) {
+        uint64_t currentHoleSize = memInfo[2 + 2 * currentIndex];
+        if (currentHoleSize >= sizeInWords && currentHoleSize > largestHoleSize) {
+            largestHoleIndex = currentIndex;
+            largestHoleSize = currentHoleSize;
+        }
+    }
+
+    return (largestHoleIndex == -1) ? -1 : static_cast<int64_t>(memInfo[1 + 2 * largestHoleIndex]);
+}
+
+// wide firstFit: same search as firstFit over a uint64_t [count, start, length, ...] list
+int64_t firstFitWide(size_t sizeInWords, void *list) {
+    uint64_t *memInfo = (uint64_t *)list;
+
+    for (uint64_t currentIndex = 0; currentIndex < memInfo[0]; currentIndex++) {
+        if (memInfo[2 + currentIndex * 2] >= sizeInWords) {
+            return static_cast<int64_t>(memInfo[1 + currentIndex * 2]);
+        }
+    }
+    return -1;
+}
+
+static uint64_t nextFitWideCursor = 0;
+
+// wide nextFit: same search as nextFit over a uint64_t [count, start, length, ...] list, with its own cursor
+int64_t nextFitWide(size_t sizeInWords, void *list) {
+    uint64_t *memInfo = (uint64_t *)list;
+    uint64_t numHoles = memInfo[0];
+
+    uint64_t resumeIndex = 0;
+    while (resumeIndex < numHoles && memInfo[1 + resumeIndex * 2] + memInfo[2 + resumeIndex * 2] <= nextFitWideCursor) {
+        resumeIndex++;
+    }
+
+    for (uint64_t step = 0; step < numHoles; step++) {
+        uint64_t currentIndex = (resumeIndex + step) % numHoles;
+        if (memInfo[2 + currentIndex * 2] >= sizeInWords) {
+            nextFitWideCursor = memInfo[1 + currentIndex * 2] + sizeInWords;
+            return static_cast<int64_t>(memInfo[1 + currentIndex * 2]);
+        }
+    }
+    return -1;
+}
+
+const NamedFit FIT_FUNCTIONS[] = {
+    {"bestFit", bestFit},
+    {"worstFit", worstFit},
+    {"firstFit", firstFit},
+    {"nextFit", nextFit},
+    {"segregatedFit", segregatedFit},
+};
+const size_t FIT_FUNCTION_COUNT = sizeof(FIT_FUNCTIONS) / sizeof(FIT_FUNCTIONS[0]);
@@ -1,5 +1,25 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 int bestFit(int sizeInWords, void *list);
 int worstFit(int sizeInWords, void *list);
+int firstFit(int sizeInWords, void *list);
+int nextFit(int sizeInWords, void *list);
+
+int segregatedFit(int sizeInWords, void *list);
+
+// wide variants: list is uint64_t [count, start, length, ...], result is a word offset or -1
+int64_t bestFitWide(size_t sizeInWords, void *list);
+int64_t worstFitWide(size_t sizeInWords, void *list);
+int64_t firstFitWide(size_t sizeInWords, void *list);
+int64_t nextFitWide(size_t sizeInWords, void *list);
 
+// the built-in strategies by name, for tools that let the user pick one
+struct NamedFit {
+    const char *name;
+    int (*allocator)(int, void *);
+};
+extern const NamedFit FIT_FUNCTIONS[];
+extern const size_t FIT_FUNCTION_COUNT;
@@ -0,0 +1,394 @@
+#include "HoleIndex.h"
+#include <map>
+#include <set>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+static const size_t MAX_SIZE_CLASSES = 64;     // one bit per class in nonEmptyBins
+
+// counters have a single writer, so a plain load and store is enough (no read-modify-write)
+static inline void add(atomic<uint64_t> &counter, int64_t delta) {
+    counter.store(counter.load(memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+
+// default size classes are the powers of two, so class k holds holes of [2^k, 2^(k+1)) words
+HoleIndex::HoleIndex()
+    : sizeOrdered(false), powerOfTwoClasses(true), nonEmptyBins(0), holesStat(0), freeWordsStat(0), largestStat(0),
+      largestKnown(true), staleChanges(0) {
+    for (auto &count : holesByClassStat) {
+        count.store(0, memory_order_relaxed);
+    }
+    for (size_t k = 0; k < MAX_SIZE_CLASSES; k++) {
+        classBounds.push_back(static_cast<size_t>(1) << k);
+    }
+}
+
+// starts over with a single hole covering the whole arena
+void HoleIndex::reset(size_t sizeInWords) {
+    clear();
+    if (sizeInWords > 0) {
+        addHole(0, sizeInWords);
+        freeWordsStat.store(sizeInWords, memory_order_relaxed);
+    }
+}
+
+void HoleIndex::clear() {
+    byStart.clear();
+    bySize.clear();
+    for (auto &sizeClass : bins) {
+        sizeClass.clear();
+    }
+    nonEmptyBins = 0;
+
+    holesStat.store(0, memory_order_relaxed);
+    freeWordsStat.store(0, memory_order_relaxed);
+    largestStat.store(0, memory_order_relaxed);
+    for (auto &count : holesByClassStat) {
+        count.store(0, memory_order_relaxed);
+    }
+    largestKnown = true;
+    staleChanges = 0;
+}
+
+// takes [start, start + length) out of the hole that contains it, leaving the leading and trailing
+// remainders (if any) behind as holes. Fails if the range is not entirely free.
+bool HoleIndex::carve(size_t start, size_t length) {
+    if (length == 0) {
+        return false;
+    }
+
+    // the containing hole is the last one starting at or before 'start'
+    auto it = byStart.upper_bound(start);
+    if (it == byStart.begin()) {
+        return false;
+    }
+    --it;
+
+    size_t holeStart = it->first;
+    size_t holeEnd = holeStart + it->second;
+    if (start + length > holeEnd) {
+        return false;              // range runs past the end of the hole
+    }
+
+    // leading remainder keeps the existing node; trailing remainder gets a new one
+    if (start > holeStart) {
+        resizeHole(it, start - holeStart);
+    } else {
+        removeHole(it);
+    }
+    if (start + length < holeEnd) {
+        addHole(start + length, holeEnd - (start + length));
+    }
+
+    add(freeWordsStat, -static_cast<int64_t>(length));
+    if (!largestKnown && ++staleChanges >= byStart.size()) {
+        findLargest();
+    }
+    return true;
+}
+
+// returns [start, start + length) to the index and coalesces it with the holes on either side
+void HoleIndex::release(size_t start, size_t length) {
+    if (length == 0) {
+        return;
+    }
+
+    add(freeWordsStat, length);
+    if (!largestKnown && ++staleChanges >= byStart.size()) {
+        findLargest();
+    }
+
+    auto next = byStart.lower_bound(start);
+    size_t end = start + length;
+
+    // merge with the following hole if it begins right where this one ends
+    if (next != byStart.end() && next->first == end) {
+        end += next->second;
+        next = removeHole(next);
+    }
+
+    // merge with the preceding hole if it ends right where this one begins
+    if (next != byStart.begin()) {
+        auto before = prev(next);
+        if (before->first + before->second == start) {
+            resizeHole(before, end - before->first);
+            return;
+        }
+    }
+
+    addHole(start, end - start);
+}
+
+size_t HoleIndex::holeCount() const {
+    return byStart.size();
+}
+
+size_t HoleIndex::lengthAt(size_t start) const {
+    auto hole = byStart.find(start);
+    return (hole == byStart.end()) ? 0 : hole->second;
+}
+
+size_t HoleIndex::lengthEndingAt(size_t end) const {
+    auto after = byStart.lower_bound(end);
+    if (after == byStart.begin()) {
+        return 0;
+    }
+    auto before = prev(after);
+    return (before->first + before->second == end) ? before->second : 0;
+}
+
+const map<size_t, size_t> &HoleIndex::holes() const {
+    return byStart;
+}
+
+// the length order costs an extra set update per hole change, so it is only kept while someone uses it
+void HoleIndex::trackSizes(bool enabled) {
+    sizeOrdered = enabled;
+    bySize.clear();
+    if (enabled) {
+        for (const auto &hole : byStart) {
+            bySize.emplace(hole.second, hole.first);
+        }
+        findLargest();
+    }
+}
+
+bool HoleIndex::tracksSizes() const {
+    return sizeOrdered;
+}
+
+// same choice as bestFit: the first hole (by address) among the smallest that fit
+size_t HoleIndex::findBest(size_t length) const {
+    auto hole = bySize.lower_bound(make_pair(length, static_cast<size_t>(0)));
+    return (hole == bySize.end()) ? npos : hole->second;
+}
+
+// same choice as worstFit: the first hole (by address) among the largest, if it fits
+size_t HoleIndex::findWorst(size_t length) const {
+    if (bySize.empty() || bySize.rbegin()->first < length) {
+        return npos;
+    }
+    return bySize.lower_bound(make_pair(bySize.rbegin()->first, static_cast<size_t>(0)))->second;
+}
+
+// same choice as firstFit
+size_t HoleIndex::findFirst(size_t length) const {
+    for (const auto &hole : byStart) {
+        if (hole.second >= length) {
+            return hole.first;
+        }
+    }
+    return npos;
+}
+
+// same choice as nextFit: resume at the hole containing (or else following) 'from' and wrap around to the start
+size_t HoleIndex::findNext(size_t length, size_t from) const {
+    auto resume = byStart.upper_bound(from);
+    if (resume != byStart.begin()) {
+        auto before = prev(resume);
+        if (before->first + before->second > from) {
+            resume = before;
+        }
+    }
+
+    for (auto hole = resume; hole != byStart.end(); ++hole) {
+        if (hole->second >= length) {
+            return hole->first;
+        }
+    }
+    for (auto hole = byStart.begin(); hole != resume; ++hole) {
+        if (hole->second >= length) {
+            return hole->first;
+        }
+    }
+    return npos;
+}
+
+size_t HoleIndex::statHoleCount() const {
+    return holesStat.load(memory_order_relaxed);
+}
+
+size_t HoleIndex::statFreeWords() const {
+    return freeWordsStat.load(memory_order_relaxed);
+}
+
+size_t HoleIndex::statLargestHole() const {
+    return largestStat.load(memory_order_relaxed);
+}
+
+uint64_t HoleIndex::statHolesInClass(size_t k) const {
+    return (k < STAT_CLASSES) ? holesByClassStat[k].load(memory_order_relaxed) : 0;
+}
+
+// replaces the size classes; bounds must start at 1 and be strictly increasing
+bool HoleIndex::setSizeClasses(const vector<size_t> &lowerBounds) {
+    if (lowerBounds.empty() || lowerBounds.size() > MAX_SIZE_CLASSES || lowerBounds[0] != 1 ||
+        adjacent_find(lowerBounds.begin(), lowerBounds.end(), greater_equal<size_t>()) != lowerBounds.end()) {
+        return false;
+    }
+
+    classBounds = lowerBounds;
+    powerOfTwoClasses = false;
+    if (lowerBounds.size() == MAX_SIZE_CLASSES) {
+        powerOfTwoClasses = true;
+        for (size_t k = 0; k < MAX_SIZE_CLASSES && powerOfTwoClasses; k++) {
+            powerOfTwoClasses = (lowerBounds[k] == static_cast<size_t>(1) << k);
+        }
+    }
+
+    // re-file the existing holes under the new classes
+    if (tracksSizeClasses()) {
+        trackSizeClasses(false);
+        trackSizeClasses(true);
+    }
+    return true;
+}
+
+// bins cost an extra set update per hole change, so they are only kept while someone uses them
+void HoleIndex::trackSizeClasses(bool enabled) {
+    bins.clear();
+    nonEmptyBins = 0;
+    if (enabled) {
+        bins.resize(classBounds.size());
+        for (const auto &hole : byStart) {
+            bin(hole.first, hole.second);
+        }
+    }
+}
+
+bool HoleIndex::tracksSizeClasses() const {
+    return !bins.empty();
+}
+
+// segregated fit: round the request up to the next class so that any hole there fits, and take the
+// lowest-addressed hole of the smallest such non-empty class. Only when every larger class is empty
+// is the request's own class searched hole by hole. Returns npos if nothing fits.
+size_t HoleIndex::findSegregated(size_t length) const {
+    if (length == 0 || !tracksSizeClasses()) {
+        return npos;
+    }
+
+    size_t requestClass = classOf(length);
+    size_t firstClass = (classBounds[requestClass] == length) ? requestClass : requestClass + 1;
+
+    if (firstClass < MAX_SIZE_CLASSES) {
+        uint64_t candidates = nonEmptyBins & (~static_cast<uint64_t>(0) << firstClass);
+        if (candidates != 0) {
+            return bins[__builtin_ctzll(candidates)].begin()->first;
+        }
+    }
+
+    for (const auto &hole : bins[requestClass]) {
+        if (hole.second >= length) {
+            return hole.first;
+        }
+    }
+    return npos;
+}
+
+// keeps the hole count and per-class histogram current, and raises the largest hole on growth
+void HoleIndex::countHole(size_t length, int delta) {
+    add(holesStat, delta);
+    add(holesByClassStat[63 - __builtin_clzll(length)], delta);
+    if (delta > 0 && largestKnown && length > largestStat.load(memory_order_relaxed)) {
+        largestStat.store(length, memory_order_relaxed);
+    }
+}
+
+// a hole of oldLength shrank or went away; if it was the largest, the largest is found again straight
+// away from the length order, or left to findLargest after enough further changes to pay for the scan
+void HoleIndex::holeShrank(size_t oldLength) {
+    if (!largestKnown || oldLength != largestStat.load(memory_order_relaxed)) {
+        return;
+    }
+    if (sizeOrdered) {
+        largestStat.store(bySize.empty() ? 0 : bySize.rbegin()->first, memory_order_relaxed);
+    } else {
+        largestKnown = false;
+        staleChanges = 0;
+    }
+}
+
+void HoleIndex::findLargest() {
+    size_t largest = 0;
+    for (const auto &hole : byStart) {
+        largest = max(largest, hole.second);
+    }
+    largestStat.store(largest, memory_order_relaxed);
+    largestKnown = true;
+}
+
+void HoleIndex::addHole(size_t start, size_t length) {
+    byStart.emplace(start, length);
+    if (sizeOrdered) {
+        bySize.emplace(length, start);
+    }
+    bin(start, length);
+    countHole(length, 1);
+}
+
+map<size_t, size_t>::iterator HoleIndex::removeHole(map<size_t, size_t>::iterator hole) {
+    size_t length = hole->second;
+    if (sizeOrdered) {
+        bySize.erase(make_pair(length, hole->first));
+    }
+    unbin(hole->first, length);
+    auto next = byStart.erase(hole);
+    countHole(length, -1);
+    holeShrank(length);
+    return next;
+}
+
+void HoleIndex::resizeHole(map<size_t, size_t>::iterator hole, size_t length) {
+    size_t oldLength = hole->second;
+    if (sizeOrdered) {
+        bySize.erase(make_pair(oldLength, hole->first));
+        bySize.emplace(length, hole->first);
+    }
+    unbin(hole->first, oldLength);
+    hole->second = length;
+    bin(hole->first, length);
+
+    // most resizes carve a small block off a large hole and leave it in the same class
+    size_t oldClass = 63 - __builtin_clzll(oldLength);
+    size_t newClass = 63 - __builtin_clzll(length);
+    if (oldClass != newClass) {
+        add(holesByClassStat[oldClass], -1);
+        add(holesByClassStat[newClass], 1);
+    }
+    if (length < oldLength) {
+        holeShrank(oldLength);
+    } else if (largestKnown && length > largestStat.load(memory_order_relaxed)) {
+        largestStat.store(length, memory_order_relaxed);
+    }
+}
+
+size_t HoleIndex::classOf(size_t length) const {
+    if (powerOfTwoClasses) {
+        return 63 - __builtin_clzll(length);
+    }
+    return upper_bound(classBounds.begin(), classBounds.end(), length) - classBounds.begin() - 1;
+}
+
+void HoleIndex::bin(size_t start, size_t length) {
+    if (!tracksSizeClasses()) {
+        return;
+    }
+    size_t sizeClass = classOf(length);
+    bins[sizeClass].emplace(start, length);
+    nonEmptyBins |= static_cast<uint64_t>(1) << sizeClass;
+}
+
+void HoleIndex::unbin(size_t start, size_t length) {
+    if (!tracksSizeClasses()) {
+        return;
+    }
+    size_t sizeClass = classOf(length);
+    bins[sizeClass].erase(make_pair(start, length));
+    if (bins[sizeClass].empty()) {
+        nonEmptyBins &= ~(static_cast<uint64_t>(1) << sizeClass);
+    }
+}
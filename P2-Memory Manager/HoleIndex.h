@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+// HoleIndex
+// address-ordered index of the free holes in an arena; neighbouring holes are always coalesced.
+// Optionally also keeps the holes ordered by length (for best/worst fit) and files every hole into a
+// size-class bin (for segregated fit), so those searches need no scan.
+class HoleIndex {
+public:
+    static const size_t npos = SIZE_MAX;
+
+    HoleIndex();
+    void reset(size_t sizeInWords);            // one hole spanning the whole arena
+    void clear();
+    bool carve(size_t start, size_t length);   // remove [start, start + length) from the hole containing it
+    void release(size_t start, size_t length); // give words back, merging with adjacent holes
+    size_t holeCount() const;
+    size_t lengthAt(size_t start) const;       // length of the hole starting at 'start', 0 if none
+    size_t lengthEndingAt(size_t end) const;   // length of the hole ending at 'end', 0 if none
+    const std::map<size_t, size_t> &holes() const;
+
+    // searches; each returns the start of the chosen hole, or npos if no hole is large enough
+    void trackSizes(bool enabled);             // maintain the length order findBest/findWorst need
+    bool tracksSizes() const;
+    size_t findBest(size_t length) const;      // smallest hole that fits, lowest address among equals
+    size_t findWorst(size_t length) const;     // largest hole, lowest address among equals
+    size_t findFirst(size_t length) const;     // lowest-addressed hole that fits
+    size_t findNext(size_t length, size_t from) const; // first fit starting at the hole holding 'from', wrapping
+
+    // statistics, kept up to date as holes change and safe to read from any thread while the owner
+    // changes the index. The largest hole is exact while the length order is tracked; otherwise, once the
+    // largest hole shrinks, it is recomputed after at most one carve/release per hole (O(1) amortized).
+    static const size_t STAT_CLASSES = 64;
+    size_t statHoleCount() const;
+    size_t statFreeWords() const;
+    size_t statLargestHole() const;
+    uint64_t statHolesInClass(size_t k) const; // holes of [2^k, 2^(k+1)) words
+
+    // size classes: class k holds holes of [lowerBounds[k], lowerBounds[k + 1]) words
+    bool setSizeClasses(const std::vector<size_t> &lowerBounds);
+    void trackSizeClasses(bool enabled);
+    bool tracksSizeClasses() const;
+    size_t findSegregated(size_t length) const;
+
+private:
+    void addHole(size_t start, size_t length);
+    std::map<size_t, size_t>::iterator removeHole(std::map<size_t, size_t>::iterator hole);
+    void resizeHole(std::map<size_t, size_t>::iterator hole, size_t length);
+    size_t classOf(size_t length) const;
+    void bin(size_t start, size_t length);
+    void unbin(size_t start, size_t length);
+    void countHole(size_t length, int delta);
+    void holeShrank(size_t oldLength);
+    void findLargest();
+
+    std::map<size_t, size_t> byStart;                      // hole start -> hole length (in words)
+    bool sizeOrdered;                                      // bySize is maintained
+    std::set<std::pair<size_t, size_t>> bySize;            // (length, start) of every hole
+    std::vector<size_t> classBounds;                       // lower bound of each size class
+    bool powerOfTwoClasses;                                // classBounds is 1, 2, 4, ... (class = log2)
+    std::vector<std::set<std::pair<size_t, size_t>>> bins; // (start, length) of the holes in each class
+    uint64_t nonEmptyBins;                                 // bit k set when bins[k] has a hole
+
+    // statistics (written only by the owner)
+    std::atomic<uint64_t> holesStat;
+    std::atomic<uint64_t> freeWordsStat;
+    std::atomic<uint64_t> largestStat;
+    std::atomic<uint64_t> holesByClassStat[STAT_CLASSES];
+    bool largestKnown;                                     // largestStat is exact
+    size_t staleChanges;                                   // carves/releases since it stopped being exact
+};
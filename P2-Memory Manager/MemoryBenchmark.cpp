@@ -0,0 +1,331 @@
+#include "MemoryManager.h"
+#include "FitFunctions.h"
+#include "AllocationTrace.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// MemoryBenchmark
+// Runs synthetic workloads (or a recorded trace) through every allocation strategy and reports
+// throughput, per-call latency, peak arena utilization and external fragmentation.
+//
+//   memorybench [--ops N] [--words N] [--word-size N] [--strategy NAME] [--workload SIZES/ORDER] [--trace FILE]
+//               [--backend fit|buddy] [--debug-sampling N] [--quarantine WORDS] [--guard-pages 0|1]
+//
+// Traces are the binary files MemoryManager::startTrace() records (see AllocationTrace.h); the arena size
+// and word size they were recorded with replace --words and --word-size.
+// Every strategy in FIT_FUNCTIONS is measured; new fit functions only need an entry there.
+// "--backend buddy" measures the buddy allocator instead; peak utilization then counts requested words,
+// so the rounding to powers of two shows up as lost utilization.
+// "--debug-sampling N" runs with debug mode on (one block in N quarantined and poison-checked, see
+// DebugArena.cpp) to measure what it costs; quarantined words count as free for peak utilization.
+
+// one allocate or free in a workload; 'id' names the block so frees can find it again
+struct Operation {
+    bool isAllocate;
+    size_t id;
+    size_t bytes;
+};
+
+struct Result {
+    size_t operations = 0;
+    double seconds = 0;
+    vector<uint32_t> latencies;    // nanoseconds per call
+    size_t failed = 0;
+    double peakUtilization = 0;    // largest share of the arena's words in use at once
+    double fragmentationSum = 0;   // sum of 1 - largest hole / free words, over samples
+    size_t fragmentationSamples = 0;
+};
+
+struct Config {
+    size_t operations = 200000;
+    size_t sizeInWords = 65536;
+    unsigned wordSize = 8;
+    string strategy;               // empty = all
+    string workload;               // empty = all, else "sizes/order"
+    string trace;
+    bool buddy = false;            // --backend buddy
+    unsigned debugSampling = 0;    // ArenaOptions::debugSampling; 0 = off
+    size_t quarantineWords = 0;
+    bool guardPages = false;
+};
+
+static const size_t FRAGMENTATION_SAMPLE_INTERVAL = 1024;
+
+
+// size distributions, in bytes
+static size_t uniformSize(mt19937_64 &rng) {
+    return uniform_int_distribution<size_t>(1, 1024)(rng);
+}
+
+static size_t bimodalSize(mt19937_64 &rng) {
+    if (uniform_int_distribution<int>(0, 9)(rng) != 0) {
+        return uniform_int_distribution<size_t>(8, 64)(rng);
+    }
+    return uniform_int_distribution<size_t>(2048, 8192)(rng);
+}
+
+static size_t powerLawSize(mt19937_64 &rng) {
+    // Pareto with minimum 8 bytes and shape 1.5, capped at 16 KiB
+    double u = uniform_real_distribution<double>(1e-9, 1.0)(rng);
+    return min<size_t>(16384, static_cast<size_t>(8.0 / pow(u, 1.0 / 1.5)));
+}
+
+// builds a workload that fills the arena to about 60% and then alternates one free with one allocate.
+// The free order decides which live block goes: newest (lifo), oldest (fifo) or any (random).
+static vector<Operation> syntheticWorkload(const Config &config, function<size_t(mt19937_64 &)> sizeOf, const string &order) {
+    mt19937_64 rng(42);
+
+    double meanBytes = 0;
+    for (int i = 0; i < 10000; i++) {
+        meanBytes += sizeOf(rng);
+    }
+    meanBytes /= 10000;
+    size_t liveTarget = max<size_t>(1, static_cast<size_t>(0.6 * config.sizeInWords * config.wordSize / meanBytes));
+
+    vector<Operation> operations;
+    deque<size_t> live;
+    size_t nextId = 0;
+    while (operations.size() < config.operations) {
+        if (live.size() < liveTarget) {
+            operations.push_back({true, nextId, sizeOf(rng)});
+            live.push_back(nextId++);
+            continue;
+        }
+
+        size_t victim;
+        if (order == "lifo") {
+            victim = live.back();
+            live.pop_back();
+        } else if (order == "fifo") {
+            victim = live.front();
+            live.pop_front();
+        } else {
+            size_t index = uniform_int_distribution<size_t>(0, live.size() - 1)(rng);
+            victim = live[index];
+            live[index] = live.back();
+            live.pop_back();
+        }
+        operations.push_back({false, victim, 0});
+    }
+    return operations;
+}
+
+// turns a recorded trace into a workload, in the same way AllocationTrace::replay reads it. A recorded
+// offset names a block only until the block is freed, so every allocation gets a fresh id; allocations that
+// failed when recorded are run and freed straight away, and frees of unknown blocks are dropped. Only the
+// first arena's calls are used: the workload stops at a second initialize record.
+static bool loadTrace(const string &fileName, Config &config, vector<Operation> &operations) {
+    unsigned wordSize;
+    vector<TraceRecord> records;
+    if (!AllocationTrace::read(fileName, wordSize, records)) {
+        return false;
+    }
+    config.wordSize = wordSize;
+
+    unordered_map<uint64_t, size_t> ids;      // recorded offset -> id of the block live there
+    size_t nextId = 0;
+    bool initialized = false;
+    for (const TraceRecord &entry : records) {
+        if (entry.op == TRACE_INITIALIZE) {
+            if (initialized) {
+                break;
+            }
+            config.sizeInWords = entry.size;
+            initialized = true;
+        } else if (entry.op == TRACE_ALLOCATE) {
+            operations.push_back({true, nextId, entry.size});
+            if (entry.offset == TRACE_FAILED) {
+                operations.push_back({false, nextId, 0});
+            } else {
+                ids[entry.offset] = nextId;
+            }
+            nextId++;
+        } else if (entry.op == TRACE_FREE) {
+            auto block = ids.find(entry.offset);
+            if (block != ids.end()) {
+                operations.push_back({false, block->second, 0});
+                ids.erase(block);
+            }
+        }
+    }
+    config.operations = operations.size();
+    return config.wordSize > 0 && config.sizeInWords > 0;
+}
+
+static Result run(const Config &config, const NamedFit &strategy, const vector<Operation> &operations) {
+    MemoryManager manager(config.wordSize, strategy.allocator);
+    ArenaOptions options;
+    options.wide = config.sizeInWords > 65536;
+    options.buddy = config.buddy;
+    options.debugSampling = config.debugSampling;
+    options.quarantineWords = config.quarantineWords;
+    options.guardPages = config.guardPages;
+    manager.initialize(config.sizeInWords, options);
+
+    Result result;
+    result.latencies.reserve(operations.size());
+    unordered_map<size_t, pair<void *, size_t>> blocks;    // id -> (address, words)
+    size_t wordsInUse = 0;
+
+    for (const Operation &operation : operations) {
+        if (operation.isAllocate) {
+            auto start = chrono::steady_clock::now();
+            void *address = manager.allocate(operation.bytes);
+            auto end = chrono::steady_clock::now();
+            result.latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+
+            if (address == nullptr) {
+                result.failed++;
+                continue;
+            }
+            // a zero-byte request still takes a one-word block, as the manager and tracereplay count it
+            size_t words = max<size_t>(1, (operation.bytes + config.wordSize - 1) / config.wordSize);
+            blocks[operation.id] = make_pair(address, words);
+            wordsInUse += words;
+            result.peakUtilization = max(result.peakUtilization, static_cast<double>(wordsInUse) / config.sizeInWords);
+        } else {
+            auto block = blocks.find(operation.id);
+            if (block == blocks.end()) {
+                continue;          // its allocation failed
+            }
+            auto start = chrono::steady_clock::now();
+            manager.free(block->second.first);
+            auto end = chrono::steady_clock::now();
+            result.latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+
+            wordsInUse -= block->second.second;
+            blocks.erase(block);
+        }
+
+        result.operations++;
+        if (result.operations % FRAGMENTATION_SAMPLE_INTERVAL == 0) {
+            result.fragmentationSum += externalFragmentation(manager);
+            result.fragmentationSamples++;
+        }
+    }
+    // throughput counts only the timed calls, not the benchmark's own bookkeeping or sampling
+    for (uint32_t latency : result.latencies) {
+        result.seconds += latency / 1e9;
+    }
+    return result;
+}
+
+static uint32_t percentile(vector<uint32_t> &latencies, double fraction) {
+    if (latencies.empty()) {
+        return 0;
+    }
+    size_t index = min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()));
+    nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+    return latencies[index];
+}
+
+static void report(const string &name, Result &result) {
+    double opsPerSecond = (result.seconds > 0) ? result.latencies.size() / result.seconds : 0;
+    double fragmentation = result.fragmentationSamples ? result.fragmentationSum / result.fragmentationSamples : 0;
+    uint32_t p50 = percentile(result.latencies, 0.50);
+    uint32_t p99 = percentile(result.latencies, 0.99);
+    printf("%-36s %12.0f %8u %8u %9.1f%% %9.3f %8zu\n", name.c_str(), opsPerSecond, p50, p99,
+           100.0 * result.peakUtilization, fragmentation, result.failed);
+}
+
+static bool parseArguments(int argc, char **argv, Config &config) {
+    for (int i = 1; i < argc; i++) {
+        string flag = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        string value = argv[++i];
+        if (flag == "--ops") {
+            config.operations = strtoull(value.c_str(), nullptr, 10);
+        } else if (flag == "--words") {
+            config.sizeInWords = strtoull(value.c_str(), nullptr, 10);
+        } else if (flag == "--word-size") {
+            config.wordSize = strtoul(value.c_str(), nullptr, 10);
+        } else if (flag == "--strategy") {
+            config.strategy = value;
+        } else if (flag == "--workload") {
+            config.workload = value;
+        } else if (flag == "--trace") {
+            config.trace = value;
+        } else if (flag == "--backend" && (value == "fit" || value == "buddy")) {
+            config.buddy = (value == "buddy");
+        } else if (flag == "--debug-sampling") {
+            config.debugSampling = strtoul(value.c_str(), nullptr, 10);
+        } else if (flag == "--quarantine") {
+            config.quarantineWords = strtoull(value.c_str(), nullptr, 10);
+        } else if (flag == "--guard-pages") {
+            config.guardPages = (value == "1");
+        } else {
+            return false;
+        }
+    }
+    return config.wordSize > 0 && config.sizeInWords > 0;
+}
+
+int main(int argc, char **argv) {
+    Config config;
+    if (!parseArguments(argc, argv, config)) {
+        fprintf(stderr, "usage: %s [--ops N] [--words N] [--word-size N] [--strategy NAME] [--workload SIZES/ORDER] [--trace FILE] [--backend fit|buddy]\n"
+                        "       [--debug-sampling N] [--quarantine WORDS] [--guard-pages 0|1]\n", argv[0]);
+        return 1;
+    }
+
+    // workloads: name -> operations
+    vector<pair<string, vector<Operation>>> workloads;
+    if (!config.trace.empty()) {
+        vector<Operation> operations;
+        if (!loadTrace(config.trace, config, operations)) {
+            fprintf(stderr, "cannot read trace %s\n", config.trace.c_str());
+            return 1;
+        }
+        workloads.emplace_back("trace", move(operations));
+    } else {
+        vector<pair<string, function<size_t(mt19937_64 &)>>> sizes = {
+            {"uniform", uniformSize}, {"bimodal", bimodalSize}, {"powerlaw", powerLawSize}};
+        for (const auto &size : sizes) {
+            for (const string order : {"lifo", "fifo", "random"}) {
+                string name = size.first + "/" + order;
+                if (config.workload.empty() || config.workload == name) {
+                    workloads.emplace_back(name, syntheticWorkload(config, size.second, order));
+                }
+            }
+        }
+    }
+
+    printf("arena: %zu words x %u bytes, %zu operations per workload\n", config.sizeInWords, config.wordSize, config.operations);
+    if (config.debugSampling > 0) {
+        printf("debug: 1 block in %u sampled, %zu quarantined words, guard pages %s\n", config.debugSampling,
+               config.quarantineWords, config.guardPages ? "on" : "off");
+    }
+    printf("%-36s %12s %8s %8s %10s %9s %8s\n", "Benchmark", "ops/s", "p50(ns)", "p99(ns)", "peak util", "ext frag", "failed");
+    for (const auto &workload : workloads) {
+        // the buddy backend ignores the fit function, so it is run once per workload
+        if (config.buddy) {
+            Result result = run(config, FIT_FUNCTIONS[0], workload.second);
+            report("buddy/" + workload.first, result);
+            continue;
+        }
+        for (size_t i = 0; i < FIT_FUNCTION_COUNT; i++) {
+            const NamedFit &strategy = FIT_FUNCTIONS[i];
+            if (!config.strategy.empty() && config.strategy != strategy.name) {
+                continue;
+            }
+            Result result = run(config, strategy, workload.second);
+            report(string(strategy.name) + "/" + workload.first, result);
+        }
+    }
+    return 0;
+}
@@ -1,14 +1,16 @@
 #include "MemoryManager.h"
 #include "FitFunctions.h"
+#include "AllocationTrace.h"
+#include "ArenaFormats.h"
 #include <vector>
 #include <functional>
 #include <utility>
 #include <fstream>
-#include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>  // mmap
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>  // MPOL_BIND
 #include <cstring>     // memset
-#include <cmath>       // ceil
 #include <iostream>
 #include <algorithm>
 
@@ -21,7 +23,34 @@ MemoryManager::MemoryManager(unsigned wordSize, function<int(int, void *)> alloc
     : wordSize(wordSize), 
       allocator(move(allocator)), 
       memoryStart(nullptr), 
-      sizeInWords(0) {}
+      sizeInWords(0),
+      reservedWords(0),
+      initialWords(0),
+      chunkWords(0),
+      mappedBytes(0),
+      commitPageSize(0),
+      memoryTracker(nullptr),
+      usedBits(nullptr),
+      nextFitCursor(0),
+      wide(false),
+      batching(false),
+      freeListCurrent(false),
+      buddy(false),
+      debugFill(false),
+      concurrent(false),
+      instanceId(0),
+      liveBlocks(nullptr),
+      purgeDelayMs(-1),
+      lazyPurge(false),
+      purgePageSize(0),
+      purgedBytes(0),
+      compactCursor(0),
+      sharedHeader(nullptr),
+      sharedBytes(0),
+      seenGeneration(0) {
+    resetStats();
+    setAllocator(this->allocator);
+}
 
 // destructor
 // cleaning up memory by calling shutdown 
@@ -30,105 +59,896 @@ MemoryManager::~MemoryManager() {
 }
 
 
+static const size_t WIDE_MAX_WORDS = UINT32_MAX;   // block lengths are tracked as uint32_t
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;   // default huge page size on x86-64 and arm64
+
+// maps 'bytes' of arena backed the way the options ask and returns it, or nullptr; mappedBytes receives
+// the length to unmap later, and pageSize the granularity mprotect and madvise work in on it (the huge
+// page size on an explicit huge page mapping). Only the first committedBytes are accessible; the rest is
+// reserved address space (PROT_NONE) for the arena to grow into. Anonymous mappings come zero-filled from the kernel, so
+// nothing is cleared here. Huge page advice and NUMA binding only affect pages faulted in afterwards, so
+// when either is in play (or only part of the mapping is committed) the arena is populated last instead
+// of with MAP_POPULATE.
+static void *mapArena(size_t bytes, size_t committedBytes, const ArenaOptions &options, size_t &mappedBytes, size_t &pageSize) {
+    pageSize = sysconf(_SC_PAGESIZE);
+    HugePages hugePages = options.hugePages;
+    bool reserving = committedBytes < bytes;
+    int protection = reserving ? PROT_NONE : PROT_READ | PROT_WRITE;
+    int populateFlag = (options.populate && options.numaNode < 0 && !reserving) ? MAP_POPULATE : 0;
+    bool populated = false;
+    void *arena = MAP_FAILED;
+
+    if (hugePages == HugePages::Explicit) {
+        mappedBytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        arena = mmap(nullptr, mappedBytes, protection, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | populateFlag, -1, 0);
+        if (arena == MAP_FAILED) {
+            cerr << "Warning: explicit huge pages unavailable, using transparent huge pages." << endl;
+            hugePages = HugePages::Transparent;
+        } else {
+            populated = (populateFlag != 0);
+            pageSize = HUGE_PAGE_SIZE;
+        }
+    }
+
+    if (hugePages == HugePages::Transparent) {
+        // over-map by one huge page and trim both ends so the arena starts on a huge page boundary
+        mappedBytes = (bytes + pageSize - 1) / pageSize * pageSize;
+        void *reserved = mmap(nullptr, mappedBytes + HUGE_PAGE_SIZE, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserved == MAP_FAILED) {
+            return nullptr;
+        }
+        uintptr_t start = reinterpret_cast<uintptr_t>(reserved);
+        uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+        if (aligned > start) {
+            munmap(reserved, aligned - start);
+        }
+        munmap(reinterpret_cast<void *>(aligned + mappedBytes), start + HUGE_PAGE_SIZE - aligned);
+        arena = reinterpret_cast<void *>(aligned);
+
+        // fails harmlessly when transparent huge pages are disabled
+        madvise(arena, mappedBytes, MADV_HUGEPAGE);
+    } else if (hugePages == HugePages::None) {
+        mappedBytes = bytes;
+        arena = mmap(nullptr, mappedBytes, protection, MAP_PRIVATE | MAP_ANONYMOUS | populateFlag, -1, 0);
+        if (arena == MAP_FAILED) {
+            return nullptr;
+        }
+        populated = (populateFlag != 0);
+    }
+
+    // open up the committed part of a reservation, in whole pages of the mapping
+    size_t committedPages = (committedBytes + pageSize - 1) / pageSize * pageSize;
+    if (reserving && committedPages > 0 && mprotect(arena, committedPages, PROT_READ | PROT_WRITE) != 0) {
+        munmap(arena, mappedBytes);
+        return nullptr;
+    }
+
+    if (options.numaNode >= 0) {
+        unsigned long nodeMask = 1UL << (options.numaNode % 64);
+        if (options.numaNode >= 64 ||
+            syscall(SYS_mbind, arena, mappedBytes, MPOL_BIND, &nodeMask, sizeof(nodeMask) * 8 + 1, 0) != 0) {
+            cerr << "Warning: could not bind the arena to NUMA node " << options.numaNode << "." << endl;
+        }
+    }
+
+    // MAP_POPULATE already did the work unless the pages had to wait for the advice or binding above
+    if (options.populate && !populated) {
+#ifdef MADV_POPULATE_WRITE
+        populated = (committedPages == 0 || madvise(arena, committedPages, MADV_POPULATE_WRITE) == 0);
+#endif
+        // kernels before 5.14: touch one byte per page
+        for (size_t offset = 0; !populated && offset < committedPages; offset += sysconf(_SC_PAGESIZE)) {
+            static_cast<volatile char *>(arena)[offset] = 0;
+        }
+    }
+    return arena;
+}
+
 // Instantiates block of requested size, no larger than 65536 words; cleans up previous block if applicable
 void MemoryManager::initialize(size_t requestedSize) {
-    const size_t MAX_MEMORY_SIZE = 65536;  // Maximum allowable memory size in words
+    initialize(requestedSize, ArenaOptions());
+}
+
+// Same, with options; wide mode raises the limit to 2^32 - 1 words. With growToWords the arena reserves
+// address space up to that size and commits more of it a chunk at a time when an allocation does not fit;
+// the reservation never moves, so growing keeps every handed-out pointer valid. With sharedFile or sharedFd
+// the arena lives in a shared mapping other processes can attach to (see SharedArena.cpp); an arena that
+// already exists there keeps its own size and blocks.
+void MemoryManager::initialize(size_t requestedSize, const ArenaOptions &options) {
+    const size_t MAX_MEMORY_SIZE = options.wide ? WIDE_MAX_WORDS : LEGACY_MAX_WORDS;  // Maximum allowable memory size in words
+    size_t reserveSize = max(requestedSize, options.growToWords);
 
     // First, check if the requested size exceeds the maximum allowable size
-    if (requestedSize > MAX_MEMORY_SIZE) {
+    if (reserveSize > MAX_MEMORY_SIZE) {
         cerr << "Error: Memory size exceeds " << MAX_MEMORY_SIZE << " words." << endl;
         return;
     }
 
+    // The purge thread works under the arena lock, which only concurrent arenas take
+    if (options.purgeThread && !options.concurrent) {
+        cerr << "Error: a purge thread needs a concurrent arena." << endl;
+        return;
+    }
+
     // Release any previously allocated memory if it exists
     if (memoryStart != nullptr) {
         shutdown();  // shutdown() method should handle memory deallocation
     }
 
+    // A shared arena brings its tracker and bitmap along in the same mapping
+    size_t arenaBytes = 0;
+    void *allocatedMemory = nullptr;
+    void *trackerMemory = nullptr;
+    void *bitsMemory = nullptr;
+    if (options.sharedFile != nullptr || options.sharedFd >= 0) {
+        if (!mapSharedArena(requestedSize, MAX_MEMORY_SIZE, options, allocatedMemory, trackerMemory, bitsMemory)) {
+            return;
+        }
+        reserveSize = requestedSize;
+        arenaBytes = requestedSize * wordSize;
+    }
+
     // Calculate the size in bytes for mmap
     size_t totalSizeInBytes = requestedSize * wordSize;
 
-    // Attempt to allocate memory using mmap
-    void* allocatedMemory = mmap(nullptr, totalSizeInBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (allocatedMemory == MAP_FAILED) {
+    // Attempt to allocate memory using mmap, with the huge page / NUMA / prefault backing asked for
+    size_t arenaPageSize = sysconf(_SC_PAGESIZE);
+    if (allocatedMemory == nullptr) {
+        allocatedMemory = mapArena(reserveSize * wordSize, totalSizeInBytes, options, arenaBytes, arenaPageSize);
+    }
+    if (allocatedMemory == nullptr) {
         cerr << "Error: Memory allocation failed." << endl;
         memoryStart = nullptr;  // Ensure memoryStart is null after a failed allocation
         return;
     }
 
+    // The memory tracker has one entry per word (0 = no block starts here). It is mapped the same way
+    // as the arena so that large trackers are zero-filled lazily by the kernel.
+    if (trackerMemory == nullptr) {
+        trackerMemory = mmap(nullptr, reserveSize * sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        bitsMemory = mmap(nullptr, usedBitsBytes(reserveSize), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    // Concurrent arenas also flag which blocks are handed out, a byte per reserved word, mapped lazily too
+    // so a large reservation costs nothing until its words are used
+    void *liveMemory = nullptr;
+    if (options.concurrent) {
+        liveMemory = mmap(nullptr, reserveSize * sizeof(atomic<uint8_t>), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (trackerMemory == MAP_FAILED || bitsMemory == MAP_FAILED || liveMemory == MAP_FAILED) {
+        cerr << "Error: Memory allocation failed." << endl;
+        munmap(allocatedMemory, arenaBytes);
+        if (trackerMemory != MAP_FAILED) {
+            munmap(trackerMemory, reserveSize * sizeof(uint32_t));
+        }
+        if (bitsMemory != MAP_FAILED) {
+            munmap(bitsMemory, usedBitsBytes(reserveSize));
+        }
+        if (liveMemory != nullptr && liveMemory != MAP_FAILED) {
+            munmap(liveMemory, reserveSize * sizeof(atomic<uint8_t>));
+        }
+        memoryStart = nullptr;
+        return;
+    }
+
     // If mmap succeeds, update memoryStart and sizeInWords
     memoryStart = allocatedMemory;
+    mappedBytes = arenaBytes;
+    commitPageSize = arenaPageSize;
     this->sizeInWords = requestedSize;
+    reservedWords = reserveSize;
+    initialWords = requestedSize;
+    chunkWords = options.chunkWords;
+    if (chunkWords == 0) {
+        chunkWords = (requestedSize > 0) ? requestedSize : max<size_t>(1, sysconf(_SC_PAGESIZE) / wordSize);
+    }
+    memoryTracker = static_cast<uint32_t *>(trackerMemory);
+    usedBits = static_cast<uint64_t *>(bitsMemory);
+    liveBlocks = static_cast<atomic<uint8_t> *>(liveMemory);
+    wide = options.wide;
+    debugFill = options.debugFill;
+    concurrent = options.concurrent;
+    buddy = options.buddy;
 
-    // Initialize memory to zero
-    memset(memoryStart, 0, totalSizeInBytes);
+    // Page purging works on whole huge pages when the arena has them, so they are not split
+    purgeDelayMs = options.purgeDelayMs;
+    lazyPurge = options.lazyPurge;
+    purgePageSize = (options.hugePages == HugePages::None) ? sysconf(_SC_PAGESIZE) : HUGE_PAGE_SIZE;
+    size_t pageWords = ((mappedBytes + purgePageSize - 1) / purgePageSize + 63) / 64;
+    recentlyDirty.assign(purgeDelayMs >= 0 ? pageWords : 0, 0);
+    agedDirty.assign(purgeDelayMs >= 0 ? pageWords : 0, 0);
+    epochStart = chrono::steady_clock::now();
+    purgedBytes = 0;
+    resetStats();
+    stats.arenaWords.store(requestedSize, memory_order_relaxed);
 
-    // Reset the memory tracker, ready for new allocations
-    memoryTracker.clear();
+    // The whole arena starts out as a single hole, unless it is shared and other processes have blocks in it
+    freeHoles.reset(requestedSize);
+    if (sharedHeader != nullptr) {
+        auto lock = lockArena();
+        rebuildHoles();
+    }
+    nextFitCursor = 0;
+    compactCursor = 0;
+    if (buddy) {
+        buddyBlocks.reset(requestedSize);
+    }
+
+    // Debug mode starts with an empty quarantine. Buddy arenas cannot place blocks between guard pages.
+    if (options.debugSampling > 0) {
+        debug.reset(new DebugState());
+        debug->sampling = options.debugSampling;
+        debug->quarantineLimit = options.quarantineWords;
+        debug->guardPages = options.guardPages && !buddy;
+        debug->pageSize = commitPageSize;
+        debug->random = 0x9E3779B97F4A7C15;
+        debug->allocationCountdown = options.debugSampling;
+        debug->freeCountdown = options.debugSampling;
+    }
+
+    // Concurrent arenas track which blocks are handed out (in liveBlocks) so frees can be checked without the lock
+    if (concurrent) {
+        registerArena();
+    }
+
+    if (options.purgeThread && purgeDelayMs > 0) {
+        startPurgeThread();
+    }
+
+    if (trace) {
+        trace->record(TRACE_INITIALIZE, requestedSize, 0);
+    }
 }
 
 
 void MemoryManager::shutdown() {
+    // The purge thread and thread caches point into the arena, so they go first
+    stopPurgeThread();
+    if (concurrent) {
+        unregisterArena();
+        threadCaches.clear();
+        munmap(liveBlocks, reservedWords * sizeof(atomic<uint8_t>));
+        liveBlocks = nullptr;
+        concurrent = false;
+    }
+
     // check for allocated memory  and release them using munmap. After release, set memoryStart to nullptr to avoid dangling pointers scenario.
-    if (memoryStart != nullptr) {
-        munmap(memoryStart, sizeInWords * wordSize);
+    // A shared arena is one mapping; the blocks in it stay behind for the other processes
+    if (sharedHeader != nullptr) {
+        munmap(sharedHeader, sharedBytes);
+        sharedHeader = nullptr;
+        arenaLock.shared = nullptr;
+    } else if (memoryStart != nullptr) {
+        munmap(memoryStart, mappedBytes);
+        munmap(memoryTracker, reservedWords * sizeof(uint32_t));
+        munmap(usedBits, usedBitsBytes(reservedWords));
     }
     memoryStart = nullptr;
+    memoryTracker = nullptr;
+    usedBits = nullptr;
+    freeHoles.clear();
+    buddyBlocks.clear();
+    debug.reset();
+    recentlyDirty.clear();
+    agedDirty.clear();
+    resetStats();
 }
 
 void *MemoryManager::allocate(size_t sizeInBytes) {
     // Check initial conditions: if no memory is initialized or the request exceeds available memory.
-    if (memoryStart == nullptr || sizeInBytes > sizeInWords * wordSize) {
+    if (memoryStart == nullptr) {
         return nullptr;
     }
 
-    // Calculate the number of words needed, rounding up.
-    int requiredWords = static_cast<int>((sizeInBytes + wordSize - 1) / wordSize);
+    void *allocatedBlock = nullptr;
+    if (sizeInBytes <= reservedWords * wordSize) {
+        // Calculate the number of words needed, rounding up.
+        size_t requiredWords = wordsFor(sizeInBytes);
+        // Buddy blocks are whole powers of two; the rounding is allocated too, so the tracker, bitmap
+        // and free list all show the block the buddy allocator actually handed out.
+        if (buddy) {
+            requiredWords = BuddyAllocator::blockWordsFor(requiredWords);
+        }
+        if (concurrent) {
+            allocatedBlock = allocateConcurrent(requiredWords);
+        } else {
+            // Check if the allocation was successful, and calculate the start address of the allocated block.
+            // Only a shared arena needs the lock here (other processes use it too).
+            unique_lock<ArenaMutex> lock;
+            if (sharedHeader != nullptr) {
+                lock = lockArena();
+            }
+            size_t allocationStart = allocateWords(requiredWords);
+            if (allocationStart != HoleIndex::npos) {
+                allocatedBlock = static_cast<char *>(memoryStart) + allocationStart * wordSize;
+            }
+        }
+        if (allocatedBlock != nullptr) {
+            countAllocation(requiredWords);
+        }
+    }
+    if (allocatedBlock == nullptr) {
+        addToStat(stats.failedAllocations, 1);
+    }
 
-    // Retrieve and process the free list only if necessary.
-    void *freeList = getList();    // Get the list of available free memory blocks
-    if (!freeList) {
-        return nullptr;            // Fail allocation if we can't get a free list (though this condition is theoretical)
+    if (trace) {
+        uint64_t offset = allocatedBlock ? (static_cast<char *>(allocatedBlock) - static_cast<char *>(memoryStart)) / wordSize : TRACE_FAILED;
+        trace->record(TRACE_ALLOCATE, sizeInBytes, offset);
     }
+    return allocatedBlock;
+}
 
-    // Attempt to allocate memory using the allocator function.
-    int allocationStart = allocator(requiredWords, freeList);
+// allocates a block whose address is a multiple of 'alignment' (a power of two). The slack in front of the
+// block is not allocated: it stays free in its hole. Concurrent arenas serve aligned blocks from the arena,
+// bypassing the thread cache; buddy blocks are aligned to their own size, so there the block is made at
+// least as large as the alignment. reallocate() does not preserve the alignment when it moves a block.
+void *MemoryManager::allocateAligned(size_t sizeInBytes, size_t alignment) {
+    if (memoryStart == nullptr) {
+        return nullptr;
+    }
 
-    // Immediately clean up the free list array to prevent memory leaks.
-    delete[] static_cast<uint16_t *>(freeList);
+    void *allocatedBlock = nullptr;
+    size_t period;
+    size_t residue;
+    if (sizeInBytes <= reservedWords * wordSize && alignmentOf(alignment, period, residue)) {
+        size_t requiredWords = wordsFor(sizeInBytes);
+        auto lock = lockArena();
+        size_t allocationStart = HoleIndex::npos;
+        if (buddy) {
+            requiredWords = max(BuddyAllocator::blockWordsFor(requiredWords), period);
+            allocationStart = (residue == 0) ? allocateWords(requiredWords) : HoleIndex::npos;
+        } else {
+            allocationStart = allocateAlignedWords(requiredWords, period, residue);
+        }
 
-    // Check if the allocation was successful.
-    if (allocationStart == -1) {
-        return nullptr;           // Allocation failed
+        if (allocationStart != HoleIndex::npos) {
+            if (concurrent) {
+                liveBlocks[allocationStart].store(1, memory_order_relaxed);
+            }
+            allocatedBlock = static_cast<char *>(memoryStart) + allocationStart * wordSize;
+            countAllocation(requiredWords);
+        }
+    }
+    if (allocatedBlock == nullptr) {
+        addToStat(stats.failedAllocations, 1);
     }
 
-    // Calculate the start address of the allocated block.
-    char *allocatedBlock = static_cast<char *>(memoryStart) + allocationStart * wordSize;
+    if (trace) {
+        uint64_t offset = allocatedBlock ? (static_cast<char *>(allocatedBlock) - static_cast<char *>(memoryStart)) / wordSize : TRACE_FAILED;
+        trace->record(TRACE_ALLOCATE, sizeInBytes, offset);
+    }
+    return allocatedBlock;
+}
+
+// takes the arena lock in concurrent or shared mode; a no-op otherwise. A shared arena is also brought up to
+// date with what other processes did since this one last held the lock.
+unique_lock<MemoryManager::ArenaMutex> MemoryManager::lockArena() {
+    if (sharedHeader == nullptr) {
+        return concurrent ? unique_lock<ArenaMutex>(arenaLock) : unique_lock<ArenaMutex>(arenaLock, defer_lock);
+    }
+    unique_lock<ArenaMutex> lock(arenaLock);
+    syncSharedArena();
+    return lock;
+}
 
-    // Mark the memory as used by setting it to a specific pattern, here using 0xFF.
-    memset(allocatedBlock, 0xFF, requiredWords * wordSize);
+// words a request takes, rounded up. A zero-byte request still gets a one-word block, as it did before the
+// hole index: the hole index has no zero-length blocks, and the caller gets a distinct address to free.
+size_t MemoryManager::wordsFor(size_t sizeInBytes) {
+    return max<size_t>(1, (sizeInBytes + wordSize - 1) / wordSize);
+}
 
-    // Track the memory usage.
-    memoryTracker.emplace_back(vector<int>{allocationStart, requiredWords});
+// carves a block of requiredWords out of the arena and returns its word offset, or npos
+size_t MemoryManager::allocateWords(size_t requiredWords) {
+    // While debugging, sampled blocks of a page or more get guard pages if there is room for them
+    if (debug != nullptr) {
+        size_t guardedStart = allocateGuarded(requiredWords);
+        if (guardedStart != HoleIndex::npos) {
+            return guardedStart;
+        }
+    }
 
-    return allocatedBlock;
+    // Ask the allocator (or the buddy allocator) for a hole, growing the arena while nothing fits.
+    size_t allocationStart = buddy ? buddyBlocks.allocate(requiredWords) : findHole(requiredWords);
+    while (allocationStart == HoleIndex::npos && growArena(requiredWords)) {
+        allocationStart = buddy ? buddyBlocks.allocate(requiredWords) : findHole(requiredWords);
+    }
+    if (allocationStart == HoleIndex::npos) {
+        return HoleIndex::npos;
+    }
+    return takeWords(allocationStart, requiredWords);
+}
+
+// allocateWords for a block whose start w must satisfy w % period == residue (see alignmentOf); the leading
+// slack before the aligned start stays in its hole
+size_t MemoryManager::allocateAlignedWords(size_t requiredWords, size_t period, size_t residue) {
+    size_t allocationStart = findAlignedHole(requiredWords, period, residue);
+    while (allocationStart == HoleIndex::npos && growArena(requiredWords + period - 1)) {
+        allocationStart = findAlignedHole(requiredWords, period, residue);
+    }
+    if (allocationStart == HoleIndex::npos) {
+        return HoleIndex::npos;
+    }
+    return takeWords(allocationStart, requiredWords);
+}
+
+// The strategy is asked for room for the block plus the most slack an alignment can need, so whichever
+// hole it picks has an aligned start the block fits behind. If no hole is that large, the lowest hole the
+// block fits in once aligned is used, so alignment never fails an allocation that has room.
+size_t MemoryManager::findAlignedHole(size_t requiredWords, size_t period, size_t residue) {
+    size_t start = findHole(requiredWords + period - 1);
+    if (start != HoleIndex::npos) {
+        return start + (residue + period - start % period) % period;
+    }
+    for (const auto &hole : freeHoles.holes()) {
+        size_t aligned = hole.first + (residue + period - hole.first % period) % period;
+        if (aligned + requiredWords <= hole.first + hole.second) {
+            return aligned;
+        }
+    }
+    return HoleIndex::npos;
+}
+
+// takes a block of requiredWords starting at allocationStart out of the arena and returns its start, or npos
+size_t MemoryManager::takeWords(size_t allocationStart, size_t requiredWords) {
+    // Take the block out of its hole; this also rejects offsets that do not point into a large enough hole.
+    if (!freeHoles.carve(allocationStart, requiredWords)) {
+        return HoleIndex::npos;
+    }
+    if (freeListCurrent) {
+        patchFreeList(allocationStart, requiredWords);
+    }
+    claimWords(allocationStart, requiredWords);
+    if (purgeDelayMs > 0) {
+        decayDirtyPages();
+    }
+
+    // Track the memory usage under the block's first word.
+    memoryTracker[allocationStart] = static_cast<uint32_t>(requiredWords);
+
+    return allocationStart;
+}
+
+// Blocks start at word offsets, so an alignment turns into a condition on the offset: (base + w * wordSize)
+// is a multiple of the alignment exactly when w % period == residue. Works for any word size; false if the
+// alignment is not a power of two or the arena base is not aligned enough for any word to qualify.
+bool MemoryManager::alignmentOf(size_t alignment, size_t &period, size_t &residue) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        return false;
+    }
+    size_t common = min<size_t>(alignment, static_cast<size_t>(wordSize) & -static_cast<size_t>(wordSize));
+    uintptr_t base = reinterpret_cast<uintptr_t>(memoryStart);
+    if (base % common != 0) {
+        return false;
+    }
+
+    // w * (wordSize / common) == -base / common (mod period), and wordSize / common is odd whenever
+    // period > 1, so it has an inverse modulo the power of two period (found by Newton's iteration)
+    period = alignment / common;
+    size_t odd = wordSize / common;
+    size_t inverse = odd;
+    for (int i = 0; i < 5; i++) {
+        inverse *= 2 - odd * inverse;
+    }
+    size_t target = (period - (base / common) % period) % period;
+    residue = (target * inverse) % period;
+    return true;
+}
+
+// returns the block starting at blockStart (which must be allocated) to the arena
+void MemoryManager::freeWords(size_t blockStart) {
+    // While debugging, sampled blocks wait in quarantine instead
+    if (debug != nullptr && quarantineBlock(blockStart)) {
+        return;
+    }
+    uint32_t blockWords = memoryTracker[blockStart];
+    memoryTracker[blockStart] = 0;
+    releaseWords(blockStart, blockWords);
+    if (buddy) {
+        buddyBlocks.release(blockStart, blockWords);
+    }
+}
+
+// marks words just carved out of the hole index as used. Allocation state lives in the tracker, hole index
+// and bitmap, so the payload is left alone unless the debug fill pattern was asked for.
+void MemoryManager::claimWords(size_t first, size_t count) {
+    if (debugFill) {
+        memset(static_cast<char *>(memoryStart) + first * wordSize, 0xFF, count * wordSize);
+    }
+    markUsed(first, count, true);
+}
+
+// hands allocated words back to the hole index; the tracker entry is the caller's business
+void MemoryManager::releaseWords(size_t first, size_t count) {
+    if (debugFill) {
+        memset(static_cast<char *>(memoryStart) + first * wordSize, 0, count * wordSize);
+    }
+    markUsed(first, count, false);
+    freeHoles.release(first, count);
+    if (purgeDelayMs >= 0) {
+        notePurgeable(first, count);
+    }
+    if (sizeInWords > initialWords) {
+        shrinkArena();
+    }
+}
+
+// commits enough chunks for a block of requiredWords to fit after the last allocated word (buddy arenas
+// may need a few rounds for alignment); false once the reservation is used up
+bool MemoryManager::growArena(size_t requiredWords) {
+    size_t trailing = freeHoles.lengthEndingAt(sizeInWords);
+    size_t needed = sizeInWords - trailing + requiredWords;
+    if (sizeInWords >= reservedWords || (!buddy && needed > reservedWords)) {
+        return false;
+    }
+
+    size_t newSize = chunkBoundary(max(needed, sizeInWords + 1));
+    if (!commitBytes(sizeInWords * wordSize, newSize * wordSize, true)) {
+        return false;
+    }
+    freeHoles.release(sizeInWords, newSize - sizeInWords);
+    if (buddy) {
+        buddyBlocks.extend(sizeInWords, newSize);
+    }
+    sizeInWords = newSize;
+    stats.arenaWords.store(newSize, memory_order_relaxed);
+    freeListCurrent = false;
+    return true;
+}
+
+// decommits the empty chunks at the end of a grown arena, keeping one spare so an arena hovering around
+// a chunk boundary does not commit and decommit on every call. Buddy arenas keep what they have grown.
+void MemoryManager::shrinkArena() {
+    size_t trailing = freeHoles.lengthEndingAt(sizeInWords);
+    if (buddy || trailing < 2 * chunkWords) {
+        return;
+    }
+
+    size_t newSize = chunkBoundary(sizeInWords - trailing + chunkWords);
+    if (newSize >= sizeInWords) {
+        return;
+    }
+    freeHoles.carve(newSize, sizeInWords - newSize);
+    commitBytes(newSize * wordSize, sizeInWords * wordSize, false);
+    sizeInWords = newSize;
+    stats.arenaWords.store(newSize, memory_order_relaxed);
+    freeListCurrent = false;
+}
+
+// the smallest arena size of at least 'words' that ends on a chunk boundary (chunks follow the initial
+// size), capped at the reservation
+size_t MemoryManager::chunkBoundary(size_t words) {
+    if (words <= initialWords) {
+        return initialWords;
+    }
+    size_t chunks = (words - initialWords + chunkWords - 1) / chunkWords;
+    return min(reservedWords, initialWords + chunks * chunkWords);
+}
+
+// makes the whole pages of arena bytes [from, to) accessible (commit) or drops and protects them again;
+// the page holding 'from' is already in use when it does not start on a page boundary. Pages are huge
+// pages on an explicit huge page mapping, which cannot be protected or dropped a part at a time.
+bool MemoryManager::commitBytes(size_t from, size_t to, bool commit) {
+    size_t pageSize = commitPageSize;
+    size_t first = (from + pageSize - 1) / pageSize * pageSize;
+    size_t last = min((to + pageSize - 1) / pageSize * pageSize, mappedBytes);
+    if (first >= last) {
+        return true;
+    }
+
+    char *pages = static_cast<char *>(memoryStart) + first;
+    if (commit) {
+        return mprotect(pages, last - first, PROT_READ | PROT_WRITE) == 0;
+    }
+    madvise(pages, last - first, MADV_DONTNEED);
+    return mprotect(pages, last - first, PROT_NONE) == 0;
+}
+
+// runs the allocator and returns the chosen word offset, or npos. The built-in strategies are answered
+// straight from the hole index (address order, length order or size-class bins) with the same choice the
+// function would make, without a list or a call through std::function; nextFit keeps its cursor per arena.
+// Any other allocator is handed the current free list, built from the hole index into a reused buffer. In wide mode the wide allocator gets the wide list; legacy allocators are only usable
+// while the arena still fits the 16-bit format. A full 65536-word arena has a hole length (65536) that
+// wraps to 0 in 16 bits, so the built-in strategies switch to their wide versions there too.
+size_t MemoryManager::findHole(size_t requiredWords) {
+    if (policy == FitPolicy::Segregated) {
+        return freeHoles.findSegregated(requiredWords);
+    }
+    if (policy == FitPolicy::Best) {
+        return freeHoles.findBest(requiredWords);
+    }
+    if (policy == FitPolicy::Worst) {
+        return freeHoles.findWorst(requiredWords);
+    }
+    if (policy == FitPolicy::First) {
+        return freeHoles.findFirst(requiredWords);
+    }
+    if (policy == FitPolicy::Next) {
+        size_t start = freeHoles.findNext(requiredWords, nextFitCursor);
+        if (start != HoleIndex::npos) {
+            nextFitCursor = start + requiredWords;
+        }
+        return start;
+    }
+
+    // Within a batch the list is built once and then patched after every carve (see patchFreeList).
+    if (usesWideList()) {
+        if (!freeListCurrent) {
+            refreshWideFreeList();
+            freeListCurrent = batching;
+        }
+        int64_t wideStart = wideAllocator(requiredWords, wideFreeList.data());
+        return (wideStart < 0) ? HoleIndex::npos : static_cast<size_t>(wideStart);
+    }
+
+    if (sizeInWords > LEGACY_MAX_WORDS || requiredWords > LEGACY_MAX_WORDS) {
+        return HoleIndex::npos;
+    }
+    if (!freeListCurrent) {
+        refreshFreeList();
+        freeListCurrent = batching;
+    }
+    int start = allocator(static_cast<int>(requiredWords), freeList.data());
+    return (start < 0) ? HoleIndex::npos : static_cast<size_t>(start);
 }
 
 void MemoryManager::free(void *address) {
-    if (memoryStart == nullptr || address == nullptr) {
+    // Ignore addresses outside the arena or not on a word boundary.
+    size_t blockStart;
+    if (memoryStart == nullptr || address == nullptr || !wordOffset(address, blockStart)) {
         return;
     }
 
-    ptrdiff_t offset = static_cast<char *>(address) - static_cast<char *>(memoryStart);
+    size_t blockWords;
+    if (concurrent) {
+        blockWords = freeConcurrent(blockStart);
+        if (blockWords == 0) {
+            return;
+        }
+    } else {
+        // The tracker is indexed by word, so the block lookup is constant time. An empty entry means the
+        // address was never handed out or has already been freed.
+        unique_lock<ArenaMutex> lock;
+        if (sharedHeader != nullptr) {
+            lock = lockArena();
+        }
+        blockWords = memoryTracker[blockStart];
+        if (blockWords == 0) {
+            return;
+        }
+        freeWords(blockStart);
+    }
+    addToStat(stats.totalFrees, 1);
+
+    if (trace) {
+        trace->record(TRACE_FREE, 0, blockStart);
+    }
+}
 
-    for (auto it = memoryTracker.begin(); it != memoryTracker.end(); ++it) {
-        ptrdiff_t blockStart = (*it)[0] * wordSize;
-        if (blockStart == offset) {
-            memset(address, 0, (*it)[1] * wordSize);
-            memoryTracker.erase(it);
-            break;
+// allocates count blocks under a single lock acquisition; addresses[i] is the block for sizesInBytes[i], or
+// nullptr if that one could not be allocated. Returns how many succeeded. The free list handed to the
+// allocator is built once per batch and patched in place after each block instead of being rebuilt from the
+// hole index every time. Concurrent arenas serve the whole batch from the arena, bypassing the thread cache.
+size_t MemoryManager::allocateBatch(const size_t *sizesInBytes, void **addresses, size_t count) {
+    if (memoryStart == nullptr) {
+        fill(addresses, addresses + count, nullptr);
+        return 0;
+    }
+
+    size_t allocated = 0;
+    auto lock = lockArena();
+    batching = true;
+    for (size_t i = 0; i < count; i++) {
+        addresses[i] = nullptr;
+        if (sizesInBytes[i] <= reservedWords * wordSize) {
+            size_t requiredWords = wordsFor(sizesInBytes[i]);
+            if (buddy) {
+                requiredWords = BuddyAllocator::blockWordsFor(requiredWords);
+            }
+            size_t allocationStart = allocateWords(requiredWords);
+            if (allocationStart != HoleIndex::npos) {
+                if (concurrent) {
+                    liveBlocks[allocationStart].store(1, memory_order_relaxed);
+                }
+                addresses[i] = static_cast<char *>(memoryStart) + allocationStart * wordSize;
+                allocated++;
+                countAllocation(requiredWords);
+            }
+        }
+        if (addresses[i] == nullptr) {
+            addToStat(stats.failedAllocations, 1);
+        }
+
+        if (trace) {
+            trace->record(TRACE_ALLOCATE, sizesInBytes[i], addresses[i] ? (static_cast<char *>(addresses[i]) - static_cast<char *>(memoryStart)) / wordSize : TRACE_FAILED);
+        }
+    }
+    batching = false;
+    freeListCurrent = false;
+    return allocated;
+}
+
+// frees count blocks under a single lock acquisition and returns how many were freed; if 'freed' is given,
+// freed[i] tells whether addresses[i] was a live block. Null addresses are skipped.
+size_t MemoryManager::freeBatch(void *const *addresses, size_t count, bool *freed) {
+    size_t released = 0;
+    auto lock = lockArena();
+    for (size_t i = 0; i < count; i++) {
+        size_t blockStart;
+        bool live = memoryStart != nullptr && addresses[i] != nullptr && wordOffset(addresses[i], blockStart) &&
+                    (concurrent ? liveBlocks[blockStart].exchange(0, memory_order_relaxed) != 0 : memoryTracker[blockStart] != 0);
+        if (live) {
+            addToStat(stats.totalFrees, 1);
+            freeWords(blockStart);
+            released++;
+            if (trace) {
+                trace->record(TRACE_FREE, 0, blockStart);
+            }
         }
+        if (freed != nullptr) {
+            freed[i] = live;
+        }
+    }
+    return released;
+}
+
+// word offset of an address inside the arena's reservation; false if it is outside or not on a word boundary.
+// The reservation does not change while the arena is up, so this needs no lock even while it grows.
+bool MemoryManager::wordOffset(void *address, size_t &offset) {
+    ptrdiff_t byteOffset = static_cast<char *>(address) - static_cast<char *>(memoryStart);
+    if (byteOffset < 0 || byteOffset % wordSize != 0 || static_cast<size_t>(byteOffset / wordSize) >= reservedWords) {
+        return false;
+    }
+    offset = byteOffset / wordSize;
+    return true;
+}
+
+// resizes the block at 'address', keeping its contents up to the smaller of the two sizes. Shrinking hands
+// the tail back to the arena. Growing first takes words from the hole right after the block, then asks the
+// allocator for a new block (copy + free), and as a last resort slides the block down into the hole right
+// before it. A null address allocates and a size of 0 frees. If the block cannot grow it is left as it was
+// and nullptr is returned. Buddy arenas shrink by splitting off buddies and grow only by moving, and blocks
+// with guard pages (debug mode) always move. In-place resizes are traced as a free followed by an allocate.
+void *MemoryManager::reallocate(void *address, size_t sizeInBytes) {
+    if (address == nullptr) {
+        return allocate(sizeInBytes);
+    }
+    if (sizeInBytes == 0) {
+        free(address);
+        return nullptr;
+    }
+
+    size_t blockStart;
+    if (memoryStart == nullptr || !wordOffset(address, blockStart) || sizeInBytes > reservedWords * wordSize) {
+        return nullptr;
+    }
+    size_t requiredWords = wordsFor(sizeInBytes);
+    if (buddy) {
+        requiredWords = BuddyAllocator::blockWordsFor(requiredWords);
+    }
+
+    // The tracker already records where the block ends, so its neighbours are a hole index lookup away.
+    size_t blockWords;
+    {
+        auto lock = lockArena();
+        bool live = concurrent ? liveBlocks[blockStart].load(memory_order_relaxed) != 0 : memoryTracker[blockStart] != 0;
+        if (!live) {
+            return nullptr;
+        }
+        blockWords = memoryTracker[blockStart];
+        if (resizeInPlace(blockStart, requiredWords)) {
+            traceResize(blockStart, blockStart, sizeInBytes);
+            return address;
+        }
+    }
+
+    // resizeInPlace only fails when growing (or for a guarded block), so the whole old block is copied
+    void *moved = allocate(sizeInBytes);
+    if (moved != nullptr) {
+        memcpy(moved, address, min(blockWords, requiredWords) * wordSize);
+        free(address);
+        return moved;
+    }
+
+    auto lock = lockArena();
+    size_t newStart = slideIntoNeighbours(blockStart, requiredWords);
+    if (newStart == HoleIndex::npos) {
+        return nullptr;
+    }
+    traceResize(blockStart, newStart, sizeInBytes);
+    return static_cast<char *>(memoryStart) + newStart * wordSize;
+}
+
+// shrinks the block, or grows it into the hole that starts where it ends; false if that hole is too small
+bool MemoryManager::resizeInPlace(size_t blockStart, size_t requiredWords) {
+    size_t blockWords = memoryTracker[blockStart];
+    if (debug != nullptr && debug->guardedBlocks.count(blockStart) != 0) {
+        return false;
+    }
+    if (requiredWords < blockWords) {
+        if (buddy) {
+            // keep the lower half until the block is small enough; every upper half is a buddy block of its own
+            for (size_t half = blockWords / 2; half >= requiredWords; half /= 2) {
+                releaseWords(blockStart + half, half);
+                buddyBlocks.release(blockStart + half, half);
+            }
+        } else {
+            releaseWords(blockStart + requiredWords, blockWords - requiredWords);
+        }
+    } else if (requiredWords > blockWords) {
+        if (buddy || !freeHoles.carve(blockStart + blockWords, requiredWords - blockWords)) {
+            return false;
+        }
+        claimWords(blockStart + blockWords, requiredWords - blockWords);
+    }
+    memoryTracker[blockStart] = static_cast<uint32_t>(requiredWords);
+    return true;
+}
+
+// moves the block down to the start of the hole that ends where it begins, also taking in the hole after it
+// if needed, and returns the new start; npos if the two neighbours and the block together are too small
+size_t MemoryManager::slideIntoNeighbours(size_t blockStart, size_t requiredWords) {
+    size_t blockWords = memoryTracker[blockStart];
+    size_t before = freeHoles.lengthEndingAt(blockStart);
+    size_t after = freeHoles.lengthAt(blockStart + blockWords);
+    if (buddy || before == 0 || before + blockWords + after < requiredWords) {
+        return HoleIndex::npos;
+    }
+
+    size_t newStart = blockStart - before;
+    char *base = static_cast<char *>(memoryStart);
+    memmove(base + newStart * wordSize, base + blockStart * wordSize, blockWords * wordSize);
+
+    // give the old range back, which merges it with both neighbours, then carve the new range out of that hole
+    memoryTracker[blockStart] = 0;
+    markUsed(blockStart, blockWords, false);
+    freeHoles.release(blockStart, blockWords);
+    freeHoles.carve(newStart, requiredWords);
+    markUsed(newStart, requiredWords, true);
+    memoryTracker[newStart] = static_cast<uint32_t>(requiredWords);
+    if (purgeDelayMs >= 0) {
+        notePurgeable(blockStart, blockWords);
+    }
+
+    // the moved payload is already in place; only the words that changed state get the debug pattern
+    if (debugFill) {
+        memset(base + (newStart + blockWords) * wordSize, 0xFF, (requiredWords - blockWords) * wordSize);
+        if (newStart + requiredWords < blockStart + blockWords) {
+            memset(base + (newStart + requiredWords) * wordSize, 0, (blockStart + blockWords - newStart - requiredWords) * wordSize);
+        }
+    }
+    if (concurrent) {
+        liveBlocks[newStart].store(1, memory_order_relaxed);
+        liveBlocks[blockStart].store(0, memory_order_relaxed);
+    }
+    return newStart;
+}
+
+void MemoryManager::traceResize(size_t oldStart, size_t newStart, size_t sizeInBytes) {
+    if (trace) {
+        trace->record(TRACE_FREE, 0, oldStart);
+        trace->record(TRACE_ALLOCATE, sizeInBytes, newStart);
+    }
+}
+
+// starts recording initialize/allocate/free calls to a binary trace file (see AllocationTrace.h).
+// If the arena is already up, its size is recorded first so the trace can be replayed on its own.
+// Not safe to call while other threads are using the manager.
+bool MemoryManager::startTrace(const char *fileName) {
+    trace.reset(new AllocationTrace());
+    if (!trace->open(fileName, wordSize)) {
+        trace.reset();
+        return false;
     }
+    if (memoryStart != nullptr) {
+        trace->record(TRACE_INITIALIZE, sizeInWords, 0);
+    }
+    return true;
+}
+
+// flushes and closes the trace file
+void MemoryManager::stopTrace() {
+    trace.reset();
 }
 
 
@@ -136,8 +956,76 @@ void MemoryManager::free(void *address) {
 // It enables allocator to call betsFit and worstFit functions indirectly during memory allocation.
 // setAllocator gets called by allocator function 
 void MemoryManager::setAllocator(function<int(int, void *)> allocator) {                                                                                                                           
+    auto lock = lockArena();
     this->allocator = move(allocator);                                                                                                                                                             
+    policy = policyOf(this->allocator);
+
+    // the built-in strategies bring their wide counterparts along; custom ones need setWideAllocator
+    if (policy == FitPolicy::Best) {
+        wideAllocator = bestFitWide;
+    } else if (policy == FitPolicy::Worst) {
+        wideAllocator = worstFitWide;
+    } else if (policy == FitPolicy::First) {
+        wideAllocator = firstFitWide;
+    } else if (policy == FitPolicy::Next) {
+        wideAllocator = nextFitWide;
+    } else {
+        wideAllocator = nullptr;
+    }
+
+    // the length order and size-class bins are only maintained while the strategy that reads them is in use
+    freeHoles.trackSizes(policy == FitPolicy::Best || policy == FitPolicy::Worst);
+    freeHoles.trackSizeClasses(policy == FitPolicy::Segregated);
 }                                                                                                                                                                                                       
+
+// replaces the power-of-two size classes used by segregatedFit; class k holds holes of
+// [lowerBounds[k], lowerBounds[k + 1]) words. Bounds must start at 1, be increasing and number at most 64.
+bool MemoryManager::setSizeClasses(const vector<size_t> &lowerBounds) {
+    auto lock = lockArena();
+    return freeHoles.setSizeClasses(lowerBounds);
+}
+
+// identifies the built-in allocators that can be answered from the hole index directly
+MemoryManager::FitPolicy MemoryManager::policyOf(const function<int(int, void *)> &allocator) {
+    auto *target = allocator.target<int (*)(int, void *)>();
+    if (target == nullptr) {
+        return FitPolicy::Custom;
+    }
+    if (*target == bestFit) {
+        return FitPolicy::Best;
+    }
+    if (*target == worstFit) {
+        return FitPolicy::Worst;
+    }
+    if (*target == firstFit) {
+        return FitPolicy::First;
+    }
+    if (*target == nextFit) {
+        return FitPolicy::Next;
+    }
+    if (*target == segregatedFit) {
+        return FitPolicy::Segregated;
+    }
+    return FitPolicy::Custom;
+}
+
+// sets the allocator used in wide mode; it receives the uint64_t list and returns a word offset or -1.
+// Replacing the wide counterpart of a built-in strategy with something else turns the hole index shortcut
+// off, so the new wide allocator is actually called.
+void MemoryManager::setWideAllocator(function<int64_t(size_t, void *)> allocator) {
+    auto lock = lockArena();
+    wideAllocator = move(allocator);
+
+    auto *target = wideAllocator.target<int64_t (*)(size_t, void *)>();
+    bool builtIn = target != nullptr && ((policy == FitPolicy::Best && *target == bestFitWide) ||
+                                         (policy == FitPolicy::Worst && *target == worstFitWide) ||
+                                         (policy == FitPolicy::First && *target == firstFitWide) ||
+                                         (policy == FitPolicy::Next && *target == nextFitWide));
+    if (policy != FitPolicy::Custom && policy != FitPolicy::Segregated && !builtIn) {
+        policy = FitPolicy::Custom;
+        freeHoles.trackSizes(false);
+    }
+}
    
 // write a text representation of the free memory blocks
 int MemoryManager::dumpMemoryMap(char *fileName) {
@@ -146,120 +1034,183 @@ int MemoryManager::dumpMemoryMap(char *fileName) {
         return -1;
     }
 
-    // Open the file with read, write permissions; create if not exists; truncate if exists.
-    int fileDescriptor = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0777);
-    if (fileDescriptor == -1) {
-        perror("Failed to open file");
-        return -1;
-    }
-
-    // Get the list of free memory blocks.
-    uint16_t *freeList = static_cast<uint16_t *>(getList());
-    if (freeList == nullptr) {
-        close(fileDescriptor);
-        return -1;
-    }
+    auto lock = lockArena();
+    return dumpHoles(freeHoles, fileName);
+}
 
-    // Check if there are any free blocks to write.
-    if (freeList[0] > 0) {
-        string buffer;
-        for (int i = 0; i < freeList[0]; ++i) {
-            // Format each memory block's information.
-            int index = 2 * i + 1;
-            buffer += "[" + to_string(freeList[index]) + ", " + to_string(freeList[index + 1]) + "]";
-            if (i < freeList[0] - 1) {
-                buffer += " - ";
-            }
-        }
 
-        // Write the formatted string to the file.
-        ssize_t writeResult = write(fileDescriptor, buffer.c_str(), buffer.size());
-        if (writeResult == -1) {
-            perror("Failed to write to file");
-            delete[] freeList;
-            close(fileDescriptor);
-            return -1;
-        }
+// returns list of available free memory holes
+void *MemoryManager::getList() {
+    // Return null if the memory has not been initialized, or is too large for 16-bit entries.
+    if (memoryStart == nullptr || sizeInWords > LEGACY_MAX_WORDS) {
+        return nullptr;
     }
 
-    // Clean up
-    delete[] freeList;
-    close(fileDescriptor);
+    // The hole index already holds the holes in address order, so just copy them out.
+    auto lock = lockArena();
+    uint16_t *list = new uint16_t[1 + 2 * freeHoles.holeCount()];
+    writeFreeList(freeHoles, list);
 
-    // Return the file descriptor (could instead return 0 for success).
-    return 0;  // Indicating success.
+    return list;
 }
 
+// rebuild the [count, start, length, ...] free list from the hole index, reusing the buffer's capacity
+void MemoryManager::refreshFreeList() {
+    freeList.resize(1 + 2 * freeHoles.holeCount());
+    writeFreeList(freeHoles, freeList.data());
+}
 
-// returns list of available free memory holes
-void *MemoryManager::getList() {
-    // Return null if the memory has not been initialized.
+// wide list: same layout as getList() with uint64_t entries
+void *MemoryManager::getListWide() {
     if (memoryStart == nullptr) {
         return nullptr;
     }
 
-    // Using a vector to track the free memory blocks.
-    vector<uint16_t> freeMemoryBlocks;
-    freeMemoryBlocks.reserve(sizeInWords);  // Optimizing for possible capacity.
-    freeMemoryBlocks.push_back(0);          // Initialize the count of free blocks to 0.
+    auto lock = lockArena();
+    uint64_t *list = new uint64_t[1 + 2 * freeHoles.holeCount()];
+    writeFreeList(freeHoles, list);
 
-    // Iterate through the memory, checking for free memory holes.
-    bool isPreviousBlockAllocated = true;
-    for (size_t i = 0; i < sizeInWords; i++) {
-        unsigned char *currentBlock = static_cast<unsigned char *>(memoryStart) + i * wordSize;
-        bool isCurrentBlockFree = (*currentBlock == 0);
+    return list;
+}
 
-        if (isPreviousBlockAllocated && isCurrentBlockFree) {
-            // Start of a new free block.
-            freeMemoryBlocks.push_back(static_cast<uint16_t>(i)); // Start index.
-            freeMemoryBlocks.push_back(1);                        // Length.
-            freeMemoryBlocks[0]++;                                 // Incrementing the count of free blocks.
-        } else if (!isPreviousBlockAllocated && isCurrentBlockFree) {
-            // Extending the current free block.
-            freeMemoryBlocks.back()++;
+// whether findHole hands the allocator the wide list rather than the 16-bit one
+bool MemoryManager::usesWideList() {
+    return (wide || sizeInWords >= LEGACY_MAX_WORDS) && wideAllocator;
+}
+
+// brings a [count, start, length, ...] list up to date after [start, start + length) was carved out of one
+// of its holes: that hole's entry is replaced by the leading and trailing remainders the hole index now has
+template <typename Entry>
+static void carveFromList(vector<Entry> &list, const HoleIndex &holes, size_t start, size_t length) {
+    size_t leading = holes.lengthEndingAt(start);
+    size_t trailing = holes.lengthAt(start + length);
+
+    // binary search for the entry of the hole the block came from, which starts at start - leading
+    size_t holeStart = start - leading;
+    size_t low = 0;
+    size_t high = list[0];
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (list[1 + 2 * middle] < holeStart) {
+            low = middle + 1;
+        } else {
+            high = middle;
         }
+    }
+    auto entry = list.begin() + 1 + 2 * low;
 
-        isPreviousBlockAllocated = !isCurrentBlockFree;
+    if (leading > 0 && trailing > 0) {
+        entry[1] = static_cast<Entry>(leading);
+        Entry remainder[2] = {static_cast<Entry>(start + length), static_cast<Entry>(trailing)};
+        list.insert(entry + 2, remainder, remainder + 2);
+        list[0]++;
+    } else if (leading > 0) {
+        entry[1] = static_cast<Entry>(leading);
+    } else if (trailing > 0) {
+        entry[0] = static_cast<Entry>(start + length);
+        entry[1] = static_cast<Entry>(trailing);
+    } else {
+        list.erase(entry, entry + 2);
+        list[0]--;
     }
+}
 
-    // Create a dynamic array to return.
-    uint16_t *freeList = new uint16_t[freeMemoryBlocks.size()];
-    copy(freeMemoryBlocks.begin(), freeMemoryBlocks.end(), freeList);
+void MemoryManager::patchFreeList(size_t start, size_t length) {
+    if (usesWideList()) {
+        carveFromList(wideFreeList, freeHoles, start, length);
+    } else {
+        carveFromList(freeList, freeHoles, start, length);
+    }
+}
 
-    return freeList;
+void MemoryManager::refreshWideFreeList() {
+    wideFreeList.resize(1 + 2 * freeHoles.holeCount());
+    writeFreeList(freeHoles, wideFreeList.data());
 }
 
 
 // generate a bitmap representing memory indicating  whether each memory block (word) is free (0) or allcated (1)
 void *MemoryManager::getBitmap() {
     // if memory block has not been initialized, no need to generate bitmap
+    if (memoryStart == nullptr || sizeInWords > LEGACY_MAX_WORDS) {
+        return nullptr;
+    }
+
+    // the extra two bytes in front store the size of the bitmap
+    auto lock = lockArena();
+    return newBitmap(usedBits, sizeInWords, 2);
+}
+
+// wide bitmap: 8-byte little-endian size header followed by the same bitmap bytes as getBitmap()
+void *MemoryManager::getBitmapWide() {
     if (memoryStart == nullptr) {
         return nullptr;
     }
 
-    // bitmap size (rounded). Each bit in the map is a word of 8 bits
-    int bitmapSize = static_cast<int>(ceil(static_cast<double>(sizeInWords) / 8.0));
-    char *bitmap = new char[bitmapSize + 2];          // the extra two bytes to store the size of the bitmap 
-    bitmap[0] = static_cast<char>(bitmapSize);
-    bitmap[1] = static_cast<char>(bitmapSize >> 8);
+    auto lock = lockArena();
+    return newBitmap(usedBits, sizeInWords, 8);
+}
 
-    // build the bitmap
-    int i = 0;  // Initialize index for the outer loop
+// keeps the used-word bitmap behind getBitmap current; a shared arena also tells the other processes
+void MemoryManager::markUsed(size_t first, size_t count, bool used) {
+    if (count == 0) {
+        return;
+    }
+    if (sharedHeader != nullptr) {
+        noteSharedChange();
+    }
+    markUsedBits(usedBits, first, count, used);
+}
 
-    while (i < bitmapSize) {                          // Outer loop to iterate through each byte/word in the memory block
-        char byte = 0;
-        int bitIndex = 7;                             // Initialize the bitIndex for the inner loop
-        while (bitIndex >= 0) {                       // Inner loop to iterate through each bit
-            byte <<= 1;
-            if (static_cast<char *>(memoryStart)[(i * 8 + bitIndex) * wordSize] != 0) {
-                byte += 1;
-            }
-            bitIndex--;                               // Decrement bitIndex
-        }
-        bitmap[i + 2] = byte;                         // Set the computed byte into the bitmap
-        i++;                                          // Increment the outer loop index
+// a snapshot of the running totals, read without the arena lock so a monitoring thread can poll it while
+// other threads allocate; nothing here walks the arena
+ArenaStats MemoryManager::getStats() {
+    ArenaStats snapshot;
+    snapshot.arenaWords = stats.arenaWords.load(memory_order_relaxed);
+    snapshot.totalFrees = stats.totalFrees.load(memory_order_relaxed);
+    snapshot.failedAllocations = stats.failedAllocations.load(memory_order_relaxed);
+    snapshot.debugErrors = stats.debugErrors.load(memory_order_relaxed);
+    snapshot.freeWords = min<size_t>(freeHoles.statFreeWords(), snapshot.arenaWords);
+    snapshot.wordsInUse = snapshot.arenaWords - snapshot.freeWords;
+    snapshot.holeCount = freeHoles.statHoleCount();
+    snapshot.largestHole = min(freeHoles.statLargestHole(), snapshot.freeWords);
+    if (snapshot.freeWords > 0) {
+        snapshot.fragmentation = 1.0 - static_cast<double>(snapshot.largestHole) / snapshot.freeWords;
+    }
+    for (size_t k = 0; k < 64; k++) {
+        snapshot.allocationsBySize[k] = stats.allocationsBySize[k].load(memory_order_relaxed);
+        snapshot.holesBySize[k] = freeHoles.statHolesInClass(k);
+        snapshot.totalAllocations += snapshot.allocationsBySize[k];
+    }
+    // a free racing with the reads may be counted before its allocation is
+    snapshot.liveAllocations = snapshot.totalAllocations - min(snapshot.totalFrees, snapshot.totalAllocations);
+    return snapshot;
+}
+
+// the thread caches allocate and free outside the lock in concurrent mode, so only there do the counters
+// need an atomic read-modify-write; otherwise a plain load and store keeps them cheap
+inline void MemoryManager::addToStat(atomic<uint64_t> &counter, int64_t delta) {
+    if (concurrent) {
+        counter.fetch_add(delta, memory_order_relaxed);
+    } else {
+        counter.store(counter.load(memory_order_relaxed) + delta, memory_order_relaxed);
+    }
+}
+
+// a block of 'words' lands in class floor(log2(words)); blocks are never empty (wordsFor rounds zero-byte
+// requests up to one word), so class 0 holds the one-word blocks
+void MemoryManager::countAllocation(size_t words) {
+    addToStat(stats.allocationsBySize[63 - __builtin_clzll(words)], 1);
+}
+
+void MemoryManager::resetStats() {
+    stats.arenaWords.store(0, memory_order_relaxed);
+    stats.totalFrees.store(0, memory_order_relaxed);
+    stats.failedAllocations.store(0, memory_order_relaxed);
+    stats.debugErrors.store(0, memory_order_relaxed);
+    for (auto &count : stats.allocationsBySize) {
+        count.store(0, memory_order_relaxed);
     }
-    return bitmap;
 }
 
 unsigned MemoryManager::getWordSize() { 
@@ -273,3 +1224,20 @@ void *MemoryManager::getMemoryStart() {
 unsigned MemoryManager::getMemoryLimit() { 
     return sizeInWords * wordSize; 
 }
+
+size_t MemoryManager::getMemoryLimitWide() {
+    return sizeInWords * wordSize;
+}
+
+// bytes the arena may grow to; equal to the memory limit unless it was initialized with growToWords
+size_t MemoryManager::getMemoryReservation() {
+    return reservedWords * wordSize;
+}
+
+bool MemoryManager::isWide() {
+    return wide;
+}
+
+bool MemoryManager::isShared() {
+    return sharedHeader != nullptr;
+}
@@ -1,8 +1,80 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
+#include <pthread.h>
+#include "BuddyAllocator.h"
 #include "FitFunctions.h"
+#include "HoleIndex.h"
+
+class AllocationTrace;
+struct iovec;
+
+// how the arena is backed by huge pages
+enum class HugePages {
+    None,                        // normal pages
+    Transparent,                 // madvise(MADV_HUGEPAGE) on an arena aligned to the huge page size
+    Explicit,                    // MAP_HUGETLB from the reserved pool; falls back to Transparent if it is short.
+                                 // Growth, purging and guard pages then work in whole huge pages
+};
+
+// options for MemoryManager::initialize
+struct ArenaOptions {
+    bool wide = false;           // 64-bit list/bitmap formats; allows arenas beyond 65536 words
+    bool concurrent = false;     // lock the arena and give each thread a small cache of free blocks
+    bool debugFill = false;      // write 0xFF over allocated blocks and 0x00 over freed ones
+    bool buddy = false;          // hand out power-of-two blocks from a buddy allocator instead of the fit function
+    HugePages hugePages = HugePages::None;
+    bool populate = false;       // fault every page in during initialize instead of on first touch
+    int numaNode = -1;           // bind the arena's pages to this NUMA node with mbind; -1 leaves placement alone
+    int purgeDelayMs = -1;       // give wholly free pages back to the OS this long after they were freed; 0 = at once, -1 = never
+    bool lazyPurge = false;      // purge with MADV_FREE (reclaimed under memory pressure) instead of MADV_DONTNEED
+    bool purgeThread = false;    // with a delay, a background thread keeps purging while the arena is idle; concurrent only
+    size_t growToWords = 0;      // reserve room to grow to this many words, committed a chunk at a time when full
+    size_t chunkWords = 0;       // growth step; 0 = the initial size (or one page if that is 0)
+    const char *sharedFile = nullptr; // share the arena with other processes through this file (e.g. under /dev/shm)
+    int sharedFd = -1;           // same, through an open descriptor (e.g. from memfd_create); not closed by the manager
+    unsigned debugSampling = 0;  // debug about one block in this many (see DebugArena.cpp); 0 = off, 1 = every block
+    size_t quarantineWords = 0;  // sampled freed blocks are held back from reuse until this many words are waiting
+    bool guardPages = false;     // sampled blocks of a page or more get a PROT_NONE page on each side
+};
+
+// what the arena costs in physical memory (MemoryManager::getResidencyStats)
+struct ResidencyStats {
+    size_t residentBytes = 0;    // arena pages currently in RAM (mincore)
+    size_t pendingPurgeBytes = 0; // freed pages waiting out the purge delay
+    size_t purgedBytes = 0;      // total handed back to the OS since initialize
+};
+
+// running totals behind MemoryManager::getStats. Each field is exact on its own, but a snapshot taken
+// while other threads allocate may mix values from neighbouring calls. Sizes are in words.
+struct ArenaStats {
+    size_t arenaWords = 0;       // committed arena size
+    size_t wordsInUse = 0;       // not in holes: live blocks (with buddy rounding) and thread-cached ones; times the word size for bytes
+    size_t liveAllocations = 0;
+    uint64_t totalAllocations = 0;
+    uint64_t totalFrees = 0;
+    uint64_t failedAllocations = 0;
+    uint64_t debugErrors = 0;    // sampled blocks found written after they were freed or past their end
+    size_t freeWords = 0;        // in holes; blocks parked in thread caches count as in use
+    size_t holeCount = 0;
+    size_t largestHole = 0;      // exact with bestFit/worstFit; otherwise may lag a few calls (see HoleIndex)
+    double fragmentation = 0;    // 1 - largestHole / freeWords; 0 when the free space is one hole
+    uint64_t allocationsBySize[64] = {}; // successful allocations of [2^k, 2^(k+1)) words since initialize
+    uint64_t holesBySize[64] = {};       // current holes of [2^k, 2^(k+1)) words
+};
+
+// told about every block MemoryManager::compact moves
+using RelocationCallback = std::function<void(void *oldAddress, void *newAddress, size_t sizeInBytes)>;
 
 // MemoryManager
 class MemoryManager {
@@ -10,21 +82,224 @@ public:
     MemoryManager(unsigned wordSize, std::function<int(int, void *)> allocator);
     ~MemoryManager();
     void initialize(size_t sizeInWords);
+    void initialize(size_t sizeInWords, const ArenaOptions &options);
     void shutdown();
     void *allocate(size_t sizeInBytes);
+    void *allocateAligned(size_t sizeInBytes, size_t alignment);
     void free(void *address);
+    void *reallocate(void *address, size_t sizeInBytes);
+    size_t allocateBatch(const size_t *sizesInBytes, void **addresses, size_t count);
+    size_t freeBatch(void *const *addresses, size_t count, bool *freed = nullptr);
+    void flushThreadCache();
+    bool startTrace(const char *fileName);
+    void stopTrace();
+    size_t purge();
+    ResidencyStats getResidencyStats();
+    ArenaStats getStats();
+    bool saveSnapshot(const char *fileName);
+    bool restoreSnapshot(const char *fileName, const ArenaOptions &options = ArenaOptions());
+    void setRelocationCallback(RelocationCallback callback);
+    bool compact(std::chrono::microseconds budget = std::chrono::microseconds::max());
     void setAllocator(std::function<int(int, void *)> allocator);
+    bool setSizeClasses(const std::vector<size_t> &lowerBounds);
     int dumpMemoryMap(char *fileName);
     void *getList();
     void *getBitmap();
     unsigned getWordSize();
     void *getMemoryStart();
     unsigned getMemoryLimit();
+    size_t getMemoryReservation();
+    size_t offsetOf(const void *address);
+    void *addressAt(size_t offset);
+    bool isShared();
+
+    // wide mode: uint64_t list entries, 8-byte bitmap size header, size_t offsets
+    void setWideAllocator(std::function<int64_t(size_t, void *)> allocator);
+    void *getListWide();
+    void *getBitmapWide();
+    size_t getMemoryLimitWide();
+    bool isWide();
 
 private:
+    // allocators MemoryManager recognizes and serves from the hole index instead of the free list
+    enum class FitPolicy { Custom, Best, Worst, First, Next, Segregated };
+
+    // concurrent mode: one thread's free blocks for one arena, binned by exact length in words
+    static const size_t CACHED_MAX_WORDS = 32;
+    struct ThreadCache {
+        std::vector<size_t> bins[CACHED_MAX_WORDS + 1];
+    };
+    struct LocalCaches;
+
+    // the arena lock: a std::mutex, or the robust process-shared mutex inside a shared arena's mapping
+    class ArenaMutex {
+    public:
+        void lock() { shared ? lockShared() : local.lock(); }
+        void unlock() { shared ? static_cast<void>(pthread_mutex_unlock(shared)) : local.unlock(); }
+
+        pthread_mutex_t *shared = nullptr;       // Set while the arena is shared
+        bool ownerDied = false;                  // A process died holding the shared mutex; cleared once repaired
+
+    private:
+        void lockShared();
+        std::mutex local;
+    };
+    struct SharedHeader;
+
+    // debug mode: a guarded block's guard regions (never handed out) and the blocks waiting in quarantine
+    struct GuardedBlock {
+        size_t beforeStart;
+        size_t afterStart;
+        size_t afterWords;
+    };
+    struct QuarantinedBlock {
+        size_t start;
+        size_t words;
+    };
+    struct DebugState {
+        unsigned sampling;                       // ArenaOptions::debugSampling
+        size_t quarantineLimit;                  // ArenaOptions::quarantineWords
+        bool guardPages;
+        size_t pageSize;
+        uint64_t random;                         // xorshift state behind the sampling countdowns
+        uint64_t allocationCountdown;            // allocations until the next sampled one
+        uint64_t freeCountdown;                  // same, for frees
+        size_t quarantinedWords = 0;
+        std::deque<QuarantinedBlock> quarantine; // oldest first
+        std::unordered_map<size_t, GuardedBlock> guardedBlocks;  // by block start
+        std::unordered_map<size_t, size_t> guardOwners;          // guard region start -> its block's start
+    };
+
+    // getStats counters, one touched per call; the rest of ArenaStats is derived from these and the hole
+    // index. Each has one writer at a time except in concurrent mode, where thread caches allocate and
+    // free without the lock and the counters take atomic adds.
+    struct StatCounters {
+        std::atomic<uint64_t> arenaWords{0};
+        std::atomic<uint64_t> totalFrees{0};
+        std::atomic<uint64_t> failedAllocations{0};
+        std::atomic<uint64_t> debugErrors{0};
+        std::atomic<uint64_t> allocationsBySize[64];
+    };
+
+    static FitPolicy policyOf(const std::function<int(int, void *)> &allocator);
+    std::unique_lock<ArenaMutex> lockArena();
+    size_t wordsFor(size_t sizeInBytes);
+    size_t allocateWords(size_t requiredWords);
+    size_t allocateAlignedWords(size_t requiredWords, size_t period, size_t residue);
+    size_t findAlignedHole(size_t requiredWords, size_t period, size_t residue);
+    size_t takeWords(size_t allocationStart, size_t requiredWords);
+    bool alignmentOf(size_t alignment, size_t &period, size_t &residue);
+    void freeWords(size_t blockStart);
+    void claimWords(size_t first, size_t count);
+    void releaseWords(size_t first, size_t count);
+    bool wordOffset(void *address, size_t &offset);
+    bool resizeInPlace(size_t blockStart, size_t requiredWords);
+    size_t slideIntoNeighbours(size_t blockStart, size_t requiredWords);
+    void traceResize(size_t oldStart, size_t newStart, size_t sizeInBytes);
+    size_t findHole(size_t requiredWords);
+    void refreshFreeList();
+    void refreshWideFreeList();
+    bool usesWideList();
+    bool growArena(size_t requiredWords);
+    void shrinkArena();
+    size_t chunkBoundary(size_t words);
+    bool commitBytes(size_t from, size_t to, bool commit);
+    void patchFreeList(size_t start, size_t length);
+    void markUsed(size_t first, size_t count, bool used);
+    void addToStat(std::atomic<uint64_t> &counter, int64_t delta);
+    void countAllocation(size_t words);
+    void resetStats();
+
+    // returning free pages to the OS (PagePurge.cpp)
+    void notePurgeable(size_t first, size_t count);
+    void decayDirtyPages();
+    void startPurgeThread();
+    void stopPurgeThread();
+    size_t purgeMarked(std::vector<uint64_t> &pages);
+    size_t purgePages(size_t firstPage, size_t lastPage);
+    bool pageIsFree(size_t page);
+
+    // shared arenas (SharedArena.cpp)
+    bool mapSharedArena(size_t &sizeInWords, size_t maxWords, const ArenaOptions &options, void *&arena, void *&tracker, void *&bits);
+    void syncSharedArena();
+    void noteSharedChange();
+    void repairSharedArena();
+    void rebuildHoles();
+
+    // debug mode (DebugArena.cpp)
+    bool sampleDebug(uint64_t &countdown);
+    size_t allocateGuarded(size_t requiredWords);
+    bool quarantineBlock(size_t blockStart);
+    void releaseQuarantined();
+    void flushQuarantine();
+    bool isGuardRegion(size_t start);
+    void reportCorruption(size_t blockStart, const char *what);
+
+    // snapshots (Snapshot.cpp)
+    void blockVectors(const std::vector<uint64_t> &table, std::vector<iovec> &vectors);
+
+    // concurrent mode (ThreadCache.cpp)
+    void registerArena();
+    void unregisterArena();
+    void *allocateConcurrent(size_t requiredWords);
+    size_t freeConcurrent(size_t blockStart);
+    ThreadCache *threadCache();
+    void refillThreadCache(ThreadCache &cache, size_t blockWords);
+    void drainThreadCache(ThreadCache &cache, size_t blockWords, size_t count);
+    void releaseThreadCache(ThreadCache *cache);
+
     unsigned int wordSize;
-    size_t sizeInWords;                          // Total words allocated
+    size_t sizeInWords;                          // Total words allocated (committed, for a growable arena)
+    size_t reservedWords;                        // Words the arena may grow to; the tracker and bitmap cover all of them
+    size_t initialWords;                         // Size passed to initialize; a growable arena never shrinks below it
+    size_t chunkWords;                           // Growth step
     void *memoryStart;                           // Start of allocated memory
-    std::vector<std::vector<int>> memoryTracker; // Tracking allocation details
+    size_t mappedBytes;                          // Length of the arena mapping (rounded up for huge pages)
+    size_t commitPageSize;                       // Granularity of mprotect/madvise on it: huge pages if explicit
+    uint32_t *memoryTracker;                     // Length of the block starting at each word, 0 if none
+    uint64_t *usedBits;                          // Bit per word, set while allocated (LSB-first, like getBitmap)
     std::function<int(int, void *)> allocator;   // Memory Allocator
+    std::function<int64_t(size_t, void *)> wideAllocator; // Memory Allocator used in wide mode
+    FitPolicy policy;                            // Which built-in allocator (if any) 'allocator' is
+    size_t nextFitCursor;                        // Where nextFit resumes: the word after its last block
+    bool wide;                                   // Arena was initialized in wide mode
+    HoleIndex freeHoles;                         // Free holes, kept up to date by allocate/free
+    std::vector<uint16_t> freeList;              // Reused buffer the allocator reads the free list from
+    std::vector<uint64_t> wideFreeList;          // Same, in the wide format
+    bool batching;                               // Inside allocateBatch: keep the free list patched, not rebuilt
+    bool freeListCurrent;                        // The list findHole reads matches freeHoles (only while batching)
+    bool buddy;                                  // Blocks come from buddyBlocks; the allocator is not consulted
+    BuddyAllocator buddyBlocks;                  // Per-order free lists while in buddy mode
+
+    bool debugFill;                              // Fill blocks on allocate/free (debug only)
+    bool concurrent;                             // Arena was initialized in concurrent mode
+    ArenaMutex arenaLock;                        // Guards everything above while concurrent or shared
+    uint64_t instanceId;                         // Names this arena to thread caches; renewed by shutdown
+    std::vector<std::unique_ptr<ThreadCache>> threadCaches;  // Every thread's cache for this arena
+    std::atomic<uint8_t> *liveBlocks;            // 1 while the block starting at a word is handed out (mapped like the tracker)
+    static thread_local LocalCaches localCaches; // Calling thread's caches, one per concurrent arena
+
+    std::unique_ptr<AllocationTrace> trace;      // Records every call while tracing is on
+    std::unique_ptr<DebugState> debug;           // Quarantine and guard pages while debugSampling is on
+
+    int purgeDelayMs;                            // ArenaOptions::purgeDelayMs of the current arena
+    bool lazyPurge;                              // Purge with MADV_FREE
+    size_t purgePageSize;                        // Granularity of purging (the huge page size with huge pages)
+    std::vector<uint64_t> recentlyDirty;         // Bit per page freed into during the current decay epoch
+    std::vector<uint64_t> agedDirty;             // Same, for the epoch before; purged when the current one ends
+    std::chrono::steady_clock::time_point epochStart;
+    size_t purgedBytes;                          // Total madvised away since initialize
+    std::thread purgeThread;                     // Ends decay epochs while idle (ArenaOptions::purgeThread)
+    std::mutex purgeThreadLock;                  // Guards stopPurging
+    std::condition_variable purgeWakeup;         // Wakes the purge thread early to stop it
+    bool stopPurging = false;
+
+    StatCounters stats;                          // Usage totals for getStats; hole totals live in freeHoles
+
+    RelocationCallback relocationCallback;       // Told about every block compact() moves
+    size_t compactCursor;                        // Where an unfinished compaction pass resumes
+
+    SharedHeader *sharedHeader;                  // Start of a shared arena's mapping (nullptr if not shared)
+    size_t sharedBytes;                          // Length of that mapping: header, tracker, bitmap and arena
+    uint64_t seenGeneration;                     // The header's generation when freeHoles was last brought up to date
 };
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include "MemoryManager.h"
+
+// ObjectPool
+// Same-size objects served from one slab carved out of a MemoryManager arena with a single allocateAligned(),
+// so the slab shows up as allocated in getBitmap() and dumpMemoryMap(). Free slots form a lock-free
+// Treiber stack: allocate/deallocate are a load and a compare-exchange on the head. The head packs the
+// top slot index with a tag that every pop bumps, so a slot popped and pushed back between another
+// thread's load and compare-exchange cannot be mistaken for an unchanged stack (ABA).
+// The pool must be destroyed before its MemoryManager is shut down.
+template <typename T>
+class ObjectPool {
+public:
+    ObjectPool(MemoryManager &manager, size_t capacity);
+    ~ObjectPool();
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool &operator=(const ObjectPool &) = delete;
+
+    void *allocate();                              // raw slot, or nullptr when the pool is empty
+    void deallocate(void *slot);
+    template <typename... Args>
+    T *create(Args &&...args);                     // allocate + construct
+    void destroy(T *object);                       // destruct + deallocate
+    size_t capacity() const;
+    bool valid() const;                            // false if the slab could not be allocated
+
+private:
+    static const uint32_t EMPTY = UINT32_MAX;     // index stored in the head when no slot is free
+
+    static uint64_t pack(uint32_t index, uint32_t tag);
+
+    MemoryManager &manager;
+    char *slab;                                    // what the arena handed out, aligned for T
+    size_t slots;
+    std::unique_ptr<std::atomic<uint32_t>[]> next; // slot below each free slot on the stack
+    std::atomic<uint64_t> head;                    // (tag << 32) | top slot index
+};
+
+
+// carves capacity slots out of the arena and pushes them all onto the free stack
+template <typename T>
+ObjectPool<T>::ObjectPool(MemoryManager &manager, size_t capacity)
+    : manager(manager), slab(nullptr), slots(0), head(pack(EMPTY, 0)) {
+    if (capacity == 0 || capacity >= EMPTY) {
+        return;
+    }
+
+    // T's alignment may be stricter than the word size
+    slab = static_cast<char *>(manager.allocateAligned(capacity * sizeof(T), alignof(T)));
+    if (slab == nullptr) {
+        return;
+    }
+    slots = capacity;
+
+    // slot 0 ends up on top, so objects are handed out in address order from a fresh pool
+    next.reset(new std::atomic<uint32_t>[slots]);
+    for (size_t i = 0; i < slots; i++) {
+        next[i].store(i + 1 < slots ? static_cast<uint32_t>(i + 1) : EMPTY, std::memory_order_relaxed);
+    }
+    head.store(pack(0, 0), std::memory_order_release);
+}
+
+template <typename T>
+ObjectPool<T>::~ObjectPool() {
+    if (slab != nullptr) {
+        manager.free(slab);
+    }
+}
+
+template <typename T>
+void *ObjectPool<T>::allocate() {
+    uint64_t top = head.load(std::memory_order_acquire);
+    while (true) {
+        uint32_t index = static_cast<uint32_t>(top);
+        if (index == EMPTY) {
+            return nullptr;
+        }
+
+        // 'next' of a slot that another thread just popped may already be stale; the tag makes the
+        // compare-exchange fail in that case, so the value is never used
+        uint32_t below = next[index].load(std::memory_order_relaxed);
+        if (head.compare_exchange_weak(top, pack(below, static_cast<uint32_t>(top >> 32) + 1),
+                                       std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return slab + static_cast<size_t>(index) * sizeof(T);
+        }
+    }
+}
+
+template <typename T>
+void ObjectPool<T>::deallocate(void *slot) {
+    if (slot == nullptr) {
+        return;
+    }
+
+    uint32_t index = static_cast<uint32_t>((static_cast<char *>(slot) - slab) / sizeof(T));
+    uint64_t top = head.load(std::memory_order_relaxed);
+    do {
+        next[index].store(static_cast<uint32_t>(top), std::memory_order_relaxed);
+    } while (!head.compare_exchange_weak(top, pack(index, static_cast<uint32_t>(top >> 32)),
+                                         std::memory_order_release, std::memory_order_relaxed));
+}
+
+template <typename T>
+template <typename... Args>
+T *ObjectPool<T>::create(Args &&...args) {
+    void *slot = allocate();
+    if (slot == nullptr) {
+        return nullptr;
+    }
+    return new (slot) T(std::forward<Args>(args)...);
+}
+
+template <typename T>
+void ObjectPool<T>::destroy(T *object) {
+    if (object == nullptr) {
+        return;
+    }
+    object->~T();
+    deallocate(object);
+}
+
+template <typename T>
+size_t ObjectPool<T>::capacity() const {
+    return slots;
+}
+
+template <typename T>
+bool ObjectPool<T>::valid() const {
+    return slab != nullptr;
+}
+
+template <typename T>
+uint64_t ObjectPool<T>::pack(uint32_t index, uint32_t tag) {
+    return (static_cast<uint64_t>(tag) << 32) | index;
+}
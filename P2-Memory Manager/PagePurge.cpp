@@ -0,0 +1,182 @@
+#include "MemoryManager.h"
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <sys/mman.h>  // madvise, mincore
+
+using namespace std;
+
+// Page purging
+// Freed words leave their pages resident until the pages are handed back with madvise. Only pages whose
+// every word is free are purged, so allocated data is never touched; a purged page reads as zeros (or,
+// with MADV_FREE, as its old contents until the kernel reclaims it) and is faulted back in on reuse.
+// With a delay, purging decays in epochs of purgeDelayMs: pages freed into during one epoch are purged
+// when the next one ends if they are still free then, so a page goes back 1-2 delays after its last free.
+// Two bits per page record this, however many frees there are.
+// Epochs only end inside allocate and free calls, so pages freed just before the arena goes idle stay
+// resident until the next call. An idle process either calls purge() itself (e.g. from a timer) or, on a
+// concurrent arena, sets ArenaOptions::purgeThread to have a background thread end the epochs on time.
+
+
+// records the pages overlapping freed words [first, first + count); with no delay they are purged at once
+void MemoryManager::notePurgeable(size_t first, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    size_t firstPage = first * wordSize / purgePageSize;
+    size_t lastPage = ((first + count) * wordSize - 1) / purgePageSize;
+    if (purgeDelayMs == 0) {
+        purgePages(firstPage, lastPage);
+        return;
+    }
+
+    for (size_t page = firstPage; page <= lastPage; page++) {
+        recentlyDirty[page / 64] |= static_cast<uint64_t>(1) << (page % 64);
+    }
+    decayDirtyPages();
+}
+
+// ends the current epoch if it has run for the delay: the pages of the epoch before are purged and the
+// current ones age. After two idle delays both generations are due.
+void MemoryManager::decayDirtyPages() {
+    auto now = chrono::steady_clock::now();
+    auto delay = chrono::milliseconds(purgeDelayMs);
+    if (now - epochStart < delay) {
+        return;
+    }
+
+    purgeMarked(agedDirty);
+    if (now - epochStart >= 2 * delay) {
+        purgeMarked(recentlyDirty);
+    }
+    swap(agedDirty, recentlyDirty);
+    epochStart = now;
+}
+
+// runs the purge thread: ends an epoch every delay until shutdown asks it to stop
+void MemoryManager::startPurgeThread() {
+    stopPurging = false;
+    purgeThread = thread([this] {
+        unique_lock<mutex> wait(purgeThreadLock);
+        while (!purgeWakeup.wait_for(wait, chrono::milliseconds(purgeDelayMs), [this] { return stopPurging; })) {
+            wait.unlock();
+            {
+                auto lock = lockArena();
+                decayDirtyPages();
+            }
+            wait.lock();
+        }
+    });
+}
+
+void MemoryManager::stopPurgeThread() {
+    if (!purgeThread.joinable()) {
+        return;
+    }
+    {
+        lock_guard<mutex> wait(purgeThreadLock);
+        stopPurging = true;
+    }
+    purgeWakeup.notify_one();
+    purgeThread.join();
+}
+
+// purges every page marked in the bitmap that is still wholly free and clears the marks; returns the bytes
+size_t MemoryManager::purgeMarked(vector<uint64_t> &pages) {
+    size_t released = 0;
+    for (size_t i = 0; i < pages.size(); i++) {
+        // runs of marked pages go to purgePages together so neighbouring free pages share one madvise
+        while (pages[i] != 0) {
+            size_t bit = __builtin_ctzll(pages[i]);
+            uint64_t run = pages[i] >> bit;
+            size_t length = (~run == 0) ? 64 - bit : __builtin_ctzll(~run);
+            released += purgePages(i * 64 + bit, i * 64 + bit + length - 1);
+            pages[i] &= ~(((length == 64) ? ~static_cast<uint64_t>(0) : ((static_cast<uint64_t>(1) << length) - 1)) << bit);
+        }
+    }
+    return released;
+}
+
+// madvises the wholly free pages among [firstPage, lastPage], contiguous ones in a single call
+size_t MemoryManager::purgePages(size_t firstPage, size_t lastPage) {
+    size_t released = 0;
+    size_t page = firstPage;
+    while (page <= lastPage) {
+        if (!pageIsFree(page)) {
+            page++;
+            continue;
+        }
+        size_t runStart = page;
+        while (page <= lastPage && pageIsFree(page)) {
+            page++;
+        }
+
+        size_t runBytes = min((page - runStart) * purgePageSize, mappedBytes - runStart * purgePageSize);
+        if (madvise(static_cast<char *>(memoryStart) + runStart * purgePageSize, runBytes,
+                    lazyPurge ? MADV_FREE : MADV_DONTNEED) == 0) {
+            released += runBytes;
+        }
+    }
+    purgedBytes += released;
+    return released;
+}
+
+// true if no allocated word overlaps the page; words past the end of the arena count as free
+bool MemoryManager::pageIsFree(size_t page) {
+    size_t firstWord = page * purgePageSize / wordSize;
+    size_t lastWord = min(((page + 1) * purgePageSize - 1) / wordSize, sizeInWords - 1);
+    if (firstWord > lastWord) {
+        return true;
+    }
+
+    for (size_t word = firstWord / 64; word <= lastWord / 64; word++) {
+        uint64_t mask = ~static_cast<uint64_t>(0);
+        if (word == firstWord / 64) {
+            mask &= ~static_cast<uint64_t>(0) << (firstWord % 64);
+        }
+        if (word == lastWord / 64) {
+            mask &= ~static_cast<uint64_t>(0) >> (63 - lastWord % 64);
+        }
+        if (usedBits[word] & mask) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// purges every freed page now, without waiting for the delay; returns the bytes handed back
+size_t MemoryManager::purge() {
+    auto lock = lockArena();
+    if (memoryStart == nullptr || purgeDelayMs < 0) {
+        return 0;
+    }
+    size_t released = purgeMarked(agedDirty) + purgeMarked(recentlyDirty);
+    epochStart = chrono::steady_clock::now();
+    return released;
+}
+
+ResidencyStats MemoryManager::getResidencyStats() {
+    ResidencyStats stats;
+    auto lock = lockArena();
+    if (memoryStart == nullptr) {
+        return stats;
+    }
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    vector<unsigned char> resident((mappedBytes + pageSize - 1) / pageSize);
+    if (mincore(memoryStart, mappedBytes, resident.data()) == 0) {
+        for (unsigned char page : resident) {
+            stats.residentBytes += (page & 1) ? pageSize : 0;
+        }
+    }
+
+    for (size_t i = 0; i < recentlyDirty.size(); i++) {
+        stats.pendingPurgeBytes += __builtin_popcountll(recentlyDirty[i] | agedDirty[i]) * purgePageSize;
+    }
+    stats.purgedBytes = purgedBytes;
+    return stats;
+}
@@ -0,0 +1,217 @@
+#include "MemoryManager.h"
+#include "ArenaFormats.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>  // flock
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// Shared arenas
+// A shared arena is a file (e.g. under /dev/shm, or a memfd) mapped MAP_SHARED by every process that uses
+// it. The file starts with a page holding SharedHeader, followed by the memory tracker and the used-word
+// bitmap, then the arena itself on a page boundary, so all allocation state lives in the mapping and the
+// processes hand blocks to each other by offset (offsetOf / addressAt) without copying them. Calls are
+// serialized by a robust process-shared mutex in the header. Each process keeps its own hole index and
+// rebuilds it from the bitmap whenever another process has changed the bitmap since it last held the lock,
+// so a shared arena suits fewer, larger blocks. Statistics, traces and the nextFit cursor stay per process.
+// Shared arenas have a fixed size and cannot be concurrent, buddy, growable, purged or debugged; compact()
+// leaves them alone, since the other processes would still hold the old offsets.
+
+struct MemoryManager::SharedHeader {
+    char magic[8];                // "MMSHARE1"
+    uint32_t wordSize;
+    uint32_t ready;               // set once the header and the mutex are initialized
+    uint64_t sizeInWords;
+    uint64_t generation;          // bumped by every change to the bitmap
+    pthread_mutex_t lock;
+};
+
+static const char SHARED_MAGIC[8] = {'M', 'M', 'S', 'H', 'A', 'R', 'E', '1'};
+
+// byte offsets of the tracker, bitmap and arena in the file, and the file's length
+struct SharedLayout {
+    size_t trackerOffset;
+    size_t bitsOffset;
+    size_t arenaOffset;
+    size_t fileBytes;
+};
+
+static SharedLayout sharedLayout(size_t headerBytes, size_t sizeInWords, size_t wordSize) {
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    SharedLayout layout;
+    layout.trackerOffset = (headerBytes + 63) / 64 * 64;
+    layout.bitsOffset = (layout.trackerOffset + sizeInWords * sizeof(uint32_t) + 7) / 8 * 8;
+    size_t bitsEnd = layout.bitsOffset + usedBitsBytes(sizeInWords);
+    layout.arenaOffset = (bitsEnd + pageSize - 1) / pageSize * pageSize;
+    layout.fileBytes = layout.arenaOffset + (sizeInWords * wordSize + pageSize - 1) / pageSize * pageSize;
+    return layout;
+}
+
+// first word in [from, end) whose bit is 'set', or end
+static size_t nextBit(const uint64_t *bits, size_t from, size_t end, bool set) {
+    while (from < end) {
+        uint64_t word = (set ? bits[from / 64] : ~bits[from / 64]) & (~static_cast<uint64_t>(0) << (from % 64));
+        if (word != 0) {
+            return min(end, from / 64 * 64 + __builtin_ctzll(word));
+        }
+        from = (from / 64 + 1) * 64;
+    }
+    return end;
+}
+
+
+// maps the shared file and returns where the arena, tracker and bitmap are in it. An empty file is set up
+// as a new arena of sizeInWords; otherwise the arena already in it is adopted and sizeInWords becomes its
+// size. The file is locked meanwhile so two processes attaching at once do not both set it up.
+bool MemoryManager::mapSharedArena(size_t &sizeInWords, size_t maxWords, const ArenaOptions &options, void *&arena, void *&tracker, void *&bits) {
+    if (options.concurrent || options.buddy || options.growToWords != 0 || options.purgeDelayMs >= 0 ||
+        options.hugePages != HugePages::None || options.numaNode >= 0 || options.debugSampling != 0) {
+        cerr << "Error: shared arenas cannot be concurrent, buddy, growable, purged, huge paged, NUMA bound or debugged." << endl;
+        return false;
+    }
+
+    int fileDescriptor = options.sharedFd;
+    if (options.sharedFile != nullptr) {
+        fileDescriptor = open(options.sharedFile, O_RDWR | O_CREAT, 0600);
+        if (fileDescriptor == -1) {
+            perror("Failed to open shared arena file");
+            return false;
+        }
+    }
+    flock(fileDescriptor, LOCK_EX);
+
+    struct stat status = {};
+    bool created = fstat(fileDescriptor, &status) == 0 && status.st_size == 0;
+    size_t fileBytes = created ? sharedLayout(sizeof(SharedHeader), sizeInWords, wordSize).fileBytes : static_cast<size_t>(status.st_size);
+    void *mapping = MAP_FAILED;
+    if (created ? ftruncate(fileDescriptor, fileBytes) == 0 : fileBytes >= sizeof(SharedHeader)) {
+        mapping = mmap(nullptr, fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED | (options.populate ? MAP_POPULATE : 0), fileDescriptor, 0);
+    }
+
+    SharedHeader *header = static_cast<SharedHeader *>(mapping);
+    bool valid = mapping != MAP_FAILED;
+    if (valid && created) {
+        // a new file reads as zeros, so the tracker and bitmap already say every word is free
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        valid = pthread_mutex_init(&header->lock, &attributes) == 0;
+        pthread_mutexattr_destroy(&attributes);
+        memcpy(header->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+        header->wordSize = wordSize;
+        header->sizeInWords = sizeInWords;
+        header->generation = 0;
+        header->ready = valid;
+    } else if (valid) {
+        valid = memcmp(header->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) == 0 && header->ready &&
+                header->wordSize == wordSize && header->sizeInWords <= maxWords &&
+                sharedLayout(sizeof(SharedHeader), header->sizeInWords, wordSize).fileBytes == fileBytes;
+    }
+
+    flock(fileDescriptor, LOCK_UN);
+    if (options.sharedFile != nullptr) {
+        close(fileDescriptor);
+    }
+    if (!valid) {
+        cerr << "Error: could not set up the shared arena." << endl;
+        if (mapping != MAP_FAILED) {
+            munmap(mapping, fileBytes);
+        }
+        return false;
+    }
+
+    sizeInWords = header->sizeInWords;
+    SharedLayout layout = sharedLayout(sizeof(SharedHeader), sizeInWords, wordSize);
+    arena = static_cast<char *>(mapping) + layout.arenaOffset;
+    tracker = static_cast<char *>(mapping) + layout.trackerOffset;
+    bits = static_cast<char *>(mapping) + layout.bitsOffset;
+    sharedHeader = header;
+    sharedBytes = fileBytes;
+    seenGeneration = header->generation;
+    arenaLock.shared = &header->lock;
+    arenaLock.ownerDied = false;
+    return true;
+}
+
+// the robust mutex reports a holder that died; whatever it was in the middle of is repaired by lockArena
+void MemoryManager::ArenaMutex::lockShared() {
+    if (pthread_mutex_lock(shared) == EOWNERDEAD) {
+        pthread_mutex_consistent(shared);
+        ownerDied = true;
+    }
+}
+
+// called with the lock held: catches up with the other processes' allocations and frees
+void MemoryManager::syncSharedArena() {
+    if (arenaLock.ownerDied) {
+        repairSharedArena();
+        arenaLock.ownerDied = false;
+    }
+    if (sharedHeader->generation != seenGeneration) {
+        rebuildHoles();
+    }
+}
+
+// records a change this process made to the bitmap; its own hole index already reflects it
+void MemoryManager::noteSharedChange() {
+    seenGeneration = ++sharedHeader->generation;
+}
+
+// A process that died holding the lock may have left a block half allocated or half freed. Blocks are
+// entered in the tracker last when allocated and removed from it first when freed, so the tracker is taken
+// as the truth and the bitmap is rebuilt from it: an interrupted allocation is undone and an interrupted
+// free completed.
+void MemoryManager::repairSharedArena() {
+    memset(usedBits, 0, usedBitsBytes(sizeInWords));
+    size_t word = 0;
+    while (word < sizeInWords) {
+        size_t blockWords = memoryTracker[word];
+        if (blockWords == 0 || blockWords > sizeInWords - word) {
+            memoryTracker[word] = 0;
+            word++;
+            continue;
+        }
+        markUsed(word, blockWords, true);
+        word += blockWords;
+    }
+    noteSharedChange();
+    rebuildHoles();
+}
+
+// rebuilds the hole index from the bitmap: every run of free words is a hole
+void MemoryManager::rebuildHoles() {
+    freeHoles.clear();
+    size_t word = nextBit(usedBits, 0, sizeInWords, false);
+    while (word < sizeInWords) {
+        size_t end = nextBit(usedBits, word, sizeInWords, true);
+        freeHoles.release(word, end - word);
+        word = nextBit(usedBits, end, sizeInWords, false);
+    }
+    seenGeneration = sharedHeader->generation;
+    freeListCurrent = false;
+}
+
+// A shared arena is mapped at a different address in every process, so blocks travel between processes as
+// byte offsets from the start of the arena: offsetOf in the sender, addressAt in the receiver. offsetOf
+// returns SIZE_MAX and addressAt nullptr for anything outside the arena.
+size_t MemoryManager::offsetOf(const void *address) {
+    ptrdiff_t offset = static_cast<const char *>(address) - static_cast<char *>(memoryStart);
+    if (memoryStart == nullptr || offset < 0 || static_cast<size_t>(offset) >= sizeInWords * wordSize) {
+        return SIZE_MAX;
+    }
+    return offset;
+}
+
+void *MemoryManager::addressAt(size_t offset) {
+    if (memoryStart == nullptr || offset >= sizeInWords * wordSize) {
+        return nullptr;
+    }
+    return static_cast<char *>(memoryStart) + offset;
+}
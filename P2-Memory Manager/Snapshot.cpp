@@ -0,0 +1,205 @@
+#include "MemoryManager.h"
+#include "AllocationTrace.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>    // IOV_MAX
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>  // fstat
+#include <sys/uio.h>  // writev, readv
+
+using namespace std;
+
+// Snapshots
+// saveSnapshot writes the arena's live blocks to a file: a 32-byte header ("MMSNAP01", uint32_t word size,
+// uint32_t reserved, uint64_t arena size in words, uint64_t block count), a table of uint64_t (start,
+// length in words) pairs in address order, then the contents of those blocks in the same order; holes are
+// not written. Block contents go out with writev straight from the arena and come back with readv straight
+// into it, one vector per run of adjacent blocks, so nothing is staged in between. restoreSnapshot puts
+// every block back at its old word offset, so offsets stored inside blocks stay valid (raw pointers do not,
+// as the new arena is mapped elsewhere).
+
+static const char SNAPSHOT_MAGIC[8] = {'M', 'M', 'S', 'N', 'A', 'P', '0', '1'};
+static const size_t SNAPSHOT_HEADER_SIZE = 32;
+
+
+// writev/readv until every vector is done, resuming after short transfers; at most IOV_MAX vectors per call
+static bool transferAll(int fileDescriptor, vector<iovec> &vectors, bool writing) {
+    size_t next = 0;
+    while (next < vectors.size()) {
+        int count = static_cast<int>(min<size_t>(vectors.size() - next, IOV_MAX));
+        ssize_t done = writing ? writev(fileDescriptor, &vectors[next], count) : readv(fileDescriptor, &vectors[next], count);
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return false;
+        }
+
+        // skip the vectors that went through whole and trim the one that was cut short
+        while (next < vectors.size() && static_cast<size_t>(done) >= vectors[next].iov_len) {
+            done -= vectors[next].iov_len;
+            next++;
+        }
+        if (done > 0) {
+            vectors[next].iov_base = static_cast<char *>(vectors[next].iov_base) + done;
+            vectors[next].iov_len -= done;
+        }
+    }
+    return true;
+}
+
+// one vector per run of adjacent blocks in a (start, length) table
+void MemoryManager::blockVectors(const vector<uint64_t> &table, vector<iovec> &vectors) {
+    char *base = static_cast<char *>(memoryStart);
+    for (size_t i = 0; i < table.size(); i += 2) {
+        if (!vectors.empty() && static_cast<char *>(vectors.back().iov_base) + vectors.back().iov_len == base + table[i] * wordSize) {
+            vectors.back().iov_len += table[i + 1] * wordSize;
+        } else {
+            vectors.push_back({base + table[i] * wordSize, table[i + 1] * wordSize});
+        }
+    }
+}
+
+// writes the live blocks to fileName; blocks parked in thread caches are not live and are left out, as are
+// guard regions (debug mode). The quarantine is released first.
+bool MemoryManager::saveSnapshot(const char *fileName) {
+    auto lock = lockArena();
+    if (memoryStart == nullptr) {
+        return false;
+    }
+    flushQuarantine();
+
+    // Every word outside a hole belongs to a block, so the blocks are found by hopping from one block
+    // start to the next between holes
+    vector<uint64_t> table;
+    const auto &holes = freeHoles.holes();
+    auto hole = holes.begin();
+    size_t word = 0;
+    while (word < sizeInWords) {
+        if (hole != holes.end() && hole->first == word) {
+            word += hole->second;
+            ++hole;
+            continue;
+        }
+        size_t blockWords = memoryTracker[word];
+        if (blockWords == 0) {
+            return false;
+        }
+        if ((!concurrent || liveBlocks[word].load(memory_order_relaxed) != 0) && !isGuardRegion(word)) {
+            table.push_back(word);
+            table.push_back(blockWords);
+        }
+        word += blockWords;
+    }
+
+    char header[SNAPSHOT_HEADER_SIZE] = {};
+    memcpy(header, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    uint32_t size = wordSize;
+    uint64_t words = sizeInWords;
+    uint64_t blocks = table.size() / 2;
+    memcpy(header + 8, &size, sizeof(size));
+    memcpy(header + 16, &words, sizeof(words));
+    memcpy(header + 24, &blocks, sizeof(blocks));
+
+    vector<iovec> vectors = {{header, sizeof(header)}, {table.data(), table.size() * sizeof(uint64_t)}};
+    blockVectors(table, vectors);
+
+    int fileDescriptor = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fileDescriptor == -1) {
+        perror("Failed to open snapshot file");
+        return false;
+    }
+    bool written = transferAll(fileDescriptor, vectors, true);
+    if (!written) {
+        perror("Failed to write snapshot file");
+    }
+    close(fileDescriptor);
+    return written;
+}
+
+// initializes the arena (with 'options', as initialize would) at the saved size and brings the saved blocks
+// back at their old offsets with their contents. The word size must match. Buddy arenas cannot place blocks
+// at given offsets, so they cannot be restored into, and neither can shared ones, which may already hold
+// blocks. The file is checked before the arena is touched: a bad or truncated file leaves the current arena
+// as it was, and only a read that fails after initialize leaves it shut down.
+bool MemoryManager::restoreSnapshot(const char *fileName, const ArenaOptions &options) {
+    if (options.buddy || options.sharedFile != nullptr || options.sharedFd >= 0) {
+        return false;
+    }
+    int fileDescriptor = open(fileName, O_RDONLY);
+    if (fileDescriptor == -1) {
+        perror("Failed to open snapshot file");
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fileDescriptor, &fileStat) != 0) {
+        close(fileDescriptor);
+        return false;
+    }
+    uint64_t fileSize = fileStat.st_size;
+
+    char header[SNAPSHOT_HEADER_SIZE] = {};
+    uint32_t size = 0;
+    uint64_t words = 0;
+    uint64_t blocks = 0;
+    vector<iovec> vectors = {{header, sizeof(header)}};
+    if (transferAll(fileDescriptor, vectors, false)) {
+        memcpy(&size, header + 8, sizeof(size));
+        memcpy(&words, header + 16, sizeof(words));
+        memcpy(&blocks, header + 24, sizeof(blocks));
+    }
+    if (memcmp(header, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || size != wordSize ||
+        words > UINT32_MAX || blocks > words || fileSize < SNAPSHOT_HEADER_SIZE ||
+        blocks > (fileSize - SNAPSHOT_HEADER_SIZE) / (2 * sizeof(uint64_t))) {
+        close(fileDescriptor);
+        return false;
+    }
+
+    // The table must describe disjoint blocks, in order, inside the arena, whose contents are all in the file
+    vector<uint64_t> table(2 * blocks);
+    vectors = {{table.data(), table.size() * sizeof(uint64_t)}};
+    bool valid = transferAll(fileDescriptor, vectors, false);
+    for (size_t i = 0; valid && i < table.size(); i += 2) {
+        size_t previousEnd = (i == 0) ? 0 : table[i - 2] + table[i - 1];
+        valid = table[i] >= previousEnd && table[i] < words && table[i + 1] > 0 && table[i + 1] <= UINT32_MAX && table[i + 1] <= words - table[i];
+    }
+    uint64_t blockWords = 0;
+    for (size_t i = 1; valid && i < table.size(); i += 2) {
+        blockWords += table[i];
+    }
+    if (!valid || blockWords * wordSize > fileSize - SNAPSHOT_HEADER_SIZE - table.size() * sizeof(uint64_t)) {
+        close(fileDescriptor);
+        return false;
+    }
+
+    initialize(words, options);
+    if (memoryStart == nullptr) {
+        close(fileDescriptor);
+        return false;
+    }
+
+    auto lock = lockArena();
+    for (size_t i = 0; i < table.size(); i += 2) {
+        takeWords(table[i], table[i + 1]);
+        if (concurrent) {
+            liveBlocks[table[i]].store(1, memory_order_relaxed);
+        }
+        countAllocation(table[i + 1]);
+        if (trace) {
+            trace->record(TRACE_ALLOCATE, table[i + 1] * wordSize, table[i]);
+        }
+    }
+
+    vectors.clear();
+    blockVectors(table, vectors);
+    bool complete = transferAll(fileDescriptor, vectors, false);
+    close(fileDescriptor);
+    if (!complete) {
+        lock.unlock();
+        shutdown();
+    }
+    return complete;
+}
@@ -0,0 +1,196 @@
+#include "MemoryManager.h"
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+#include <cstring>     // memset
+
+using namespace std;
+
+// Concurrent mode
+// Blocks of up to CACHED_MAX_WORDS words (32) are served from per-thread caches without taking the arena lock.
+// A cache is refilled CACHE_BATCH blocks at a time and hands half of a bin back once it grows past
+// CACHE_HIGH_WATER. Cached blocks count as allocated in getList()/getBitmap() until they are returned.
+
+static const size_t CACHE_BATCH = 16;          // blocks carved per refill
+static const size_t CACHE_HIGH_WATER = 64;     // bin length that triggers a return to the arena
+
+// the caches a thread has picked up, keyed by arena instance id. When the thread exits, each cache is
+// handed back to its arena if that arena is still alive.
+struct MemoryManager::LocalCaches {
+    vector<pair<uint64_t, ThreadCache *>> caches;
+    ~LocalCaches();
+};
+
+thread_local MemoryManager::LocalCaches MemoryManager::localCaches;
+
+// live concurrent arenas by instance id; lets exiting threads tell whether their arena still exists.
+// Both are leaked on purpose so they outlive every thread_local destructor.
+static mutex &registryLock() {
+    static mutex *lock = new mutex;
+    return *lock;
+}
+
+static unordered_map<uint64_t, MemoryManager *> &liveArenas() {
+    static unordered_map<uint64_t, MemoryManager *> *arenas = new unordered_map<uint64_t, MemoryManager *>;
+    return *arenas;
+}
+
+// instance ids are never reused, so a stale id in some thread's cache list can never match a new arena
+static atomic<uint64_t> nextInstanceId(1);
+
+
+MemoryManager::LocalCaches::~LocalCaches() {
+    if (caches.empty()) {
+        return;
+    }
+    lock_guard<mutex> registry(registryLock());
+    for (auto &entry : caches) {
+        auto owner = liveArenas().find(entry.first);
+        if (owner != liveArenas().end()) {
+            owner->second->releaseThreadCache(entry.second);
+        }
+    }
+}
+
+void MemoryManager::registerArena() {
+    lock_guard<mutex> registry(registryLock());
+    instanceId = nextInstanceId++;
+    liveArenas()[instanceId] = this;
+}
+
+// waits out any exiting thread that is still handing its cache back
+void MemoryManager::unregisterArena() {
+    lock_guard<mutex> registry(registryLock());
+    liveArenas().erase(instanceId);
+    instanceId = 0;
+}
+
+void *MemoryManager::allocateConcurrent(size_t requiredWords) {
+    size_t allocationStart;
+    if (requiredWords <= CACHED_MAX_WORDS && debug == nullptr) {
+        ThreadCache *cache = threadCache();
+        vector<size_t> &bin = cache->bins[requiredWords];
+        if (bin.empty()) {
+            refillThreadCache(*cache, requiredWords);
+            if (bin.empty()) {
+                return nullptr;
+            }
+        }
+        allocationStart = bin.back();
+        bin.pop_back();
+    } else {
+        auto lock = lockArena();
+        allocationStart = allocateWords(requiredWords);
+        if (allocationStart == HoleIndex::npos) {
+            return nullptr;
+        }
+    }
+
+    liveBlocks[allocationStart].store(1, memory_order_relaxed);
+    return static_cast<char *>(memoryStart) + allocationStart * wordSize;
+}
+
+// returns the freed block's length in words, or 0 if there was no live block at blockStart
+size_t MemoryManager::freeConcurrent(size_t blockStart) {
+    // Rejects double frees and addresses that were never handed out, without the lock
+    if (liveBlocks[blockStart].exchange(0, memory_order_relaxed) == 0) {
+        return 0;
+    }
+
+    // The tracker entry was written under the lock before the block was handed out and does not
+    // change while the block is live, so it can be read here directly.
+    uint32_t blockWords = memoryTracker[blockStart];
+    if (blockWords > CACHED_MAX_WORDS || debug != nullptr) {
+        auto lock = lockArena();
+        freeWords(blockStart);
+        return blockWords;
+    }
+
+    // Cached blocks are still allocated as far as the arena is concerned
+    if (debugFill) {
+        memset(static_cast<char *>(memoryStart) + blockStart * wordSize, 0xFF, blockWords * wordSize);
+    }
+
+    ThreadCache *cache = threadCache();
+    vector<size_t> &bin = cache->bins[blockWords];
+    bin.push_back(blockStart);
+    if (bin.size() > CACHE_HIGH_WATER) {
+        drainThreadCache(*cache, blockWords, bin.size() - CACHE_HIGH_WATER / 2);
+    }
+    return blockWords;
+}
+
+// the calling thread's cache for this arena, created on first use
+MemoryManager::ThreadCache *MemoryManager::threadCache() {
+    for (auto &entry : localCaches.caches) {
+        if (entry.first == instanceId) {
+            return entry.second;
+        }
+    }
+
+    // Drop entries for arenas that have shut down since this thread last looked
+    {
+        lock_guard<mutex> registry(registryLock());
+        auto &caches = localCaches.caches;
+        caches.erase(remove_if(caches.begin(), caches.end(), [](const pair<uint64_t, ThreadCache *> &entry) {
+            return liveArenas().count(entry.first) == 0;
+        }), caches.end());
+    }
+
+    auto lock = lockArena();
+    threadCaches.emplace_back(new ThreadCache());
+    ThreadCache *cache = threadCaches.back().get();
+    localCaches.caches.emplace_back(instanceId, cache);
+    return cache;
+}
+
+// carves a batch of blockWords-sized blocks under a single lock acquisition
+void MemoryManager::refillThreadCache(ThreadCache &cache, size_t blockWords) {
+    auto lock = lockArena();
+    for (size_t i = 0; i < CACHE_BATCH; i++) {
+        size_t blockStart = allocateWords(blockWords);
+        if (blockStart == HoleIndex::npos) {
+            break;
+        }
+        cache.bins[blockWords].push_back(blockStart);
+    }
+}
+
+// hands the oldest 'count' blocks of a bin back to the arena
+void MemoryManager::drainThreadCache(ThreadCache &cache, size_t blockWords, size_t count) {
+    vector<size_t> &bin = cache.bins[blockWords];
+    count = min(count, bin.size());
+
+    auto lock = lockArena();
+    for (size_t i = 0; i < count; i++) {
+        freeWords(bin[i]);
+    }
+    bin.erase(bin.begin(), bin.begin() + count);
+}
+
+// returns every block parked in the calling thread's cache to the arena
+void MemoryManager::flushThreadCache() {
+    if (!concurrent) {
+        return;
+    }
+    ThreadCache *cache = threadCache();
+    for (size_t blockWords = 1; blockWords <= CACHED_MAX_WORDS; blockWords++) {
+        drainThreadCache(*cache, blockWords, cache->bins[blockWords].size());
+    }
+}
+
+// called by an exiting thread (with the registry locked): give the blocks back and drop the cache
+void MemoryManager::releaseThreadCache(ThreadCache *cache) {
+    auto lock = lockArena();
+    for (auto &bin : cache->bins) {
+        for (size_t blockStart : bin) {
+            freeWords(blockStart);
+        }
+    }
+    threadCaches.erase(remove_if(threadCaches.begin(), threadCaches.end(), [cache](const unique_ptr<ThreadCache> &owned) {
+        return owned.get() == cache;
+    }), threadCaches.end());
+}
@@ -0,0 +1,42 @@
+#include "AllocationTrace.h"
+#include "FitFunctions.h"
+#include <cstdio>
+#include <cstring>
+
+// TraceReplay
+// Replays a trace recorded with MemoryManager::startTrace() through each built-in strategy (or just the
+// one named) and compares how they cope with the recorded workload. "memorybench --trace" runs the same
+// trace with per-call latency percentiles.
+//
+//   tracereplay <trace file> [strategy]
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s <trace file> [strategy]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-16s %10s %8s %10s %10s %10s %10s\n", "Strategy", "allocs", "failed", "frees", "peak util", "final frag", "time(ms)");
+    bool matched = false;
+    for (size_t i = 0; i < FIT_FUNCTION_COUNT; i++) {
+        const NamedFit &strategy = FIT_FUNCTIONS[i];
+        if (argc == 3 && strcmp(argv[2], strategy.name) != 0) {
+            continue;
+        }
+        matched = true;
+
+        ReplayResult result;
+        if (!AllocationTrace::replay(argv[1], strategy.allocator, result)) {
+            fprintf(stderr, "cannot read trace %s\n", argv[1]);
+            return 1;
+        }
+        printf("%-16s %10zu %8zu %10zu %9.1f%% %10.3f %10.2f\n", strategy.name, result.allocations, result.failedAllocations,
+               result.frees, 100.0 * result.peakUtilization, result.finalFragmentation, 1000.0 * result.seconds);
+    }
+
+    if (!matched) {
+        fprintf(stderr, "unknown strategy %s\n", argv[2]);
+        return 1;
+    }
+    return 0;
+}
@@ -7,12 +7,20 @@
 #include <map>           // To use std::map
 #include <stack>         // To use std::stack
 #include <regex>         // For regex matching patterns
+#include <algorithm>     // For std::min
+#include <cstring>       // For memcpy
+#include <fcntl.h>       // For open
+#include <unistd.h>      // For close
+#include <sys/mman.h>    // For mmap
+#include <sys/stat.h>    // For fstat
 
 
 //constructor
 Wad::Wad(const std::string& path) {
     // open file & read header
     wadPath = path;
+    fileData = nullptr;
+    fileSize = 0;
     currentFile.open(path, std::ios::in | std::ios::out | std::ios::binary);
 
     magic[4] = '\0';
@@ -98,6 +106,39 @@ Wad::Wad(const std::string& path) {
         fileMap[fullFilePath] = new DescriptorObject(nameStr, dataOffset, dataLength, contentNode);
         parentNode->children.push_back(contentNode);
     }
+
+    // map the file so lump contents can be read without going through the stream
+    mapFile();
+}
+
+Wad::~Wad() {
+    if (fileData != nullptr)
+        munmap(const_cast<char*>(fileData), fileSize);
+}
+
+// (re)maps the whole file read-only. The mapping is shared, so it follows the file's contents, but it has
+// to be redone whenever the file grows; every write path calls this once it is done with the stream.
+void Wad::mapFile() {
+    if (fileData != nullptr)
+        munmap(const_cast<char*>(fileData), fileSize);
+    fileData = nullptr;
+    fileSize = 0;
+
+    // push pending stream writes to the file first, so the mapping sees them
+    currentFile.flush();
+
+    int fd = open(wadPath.c_str(), O_RDONLY);
+    if (fd == -1)
+        return;
+    struct stat fileStatus;
+    if (fstat(fd, &fileStatus) == 0 && fileStatus.st_size > 0) {
+        void* mapping = mmap(nullptr, fileStatus.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED) {
+            fileData = static_cast<const char*>(mapping);
+            fileSize = fileStatus.st_size;
+        }
+    }
+    close(fd);
 }
 
 Wad* Wad::loadWad(const string &path) {
@@ -149,33 +190,42 @@ int Wad::getSize(const string &path) {
 }
 
 int Wad::getContents(const std::string& path, char* buffer, int length, int offset) {
-    //reject non-file paths
-    if (!isContent(path))
+    //find the bytes in the mapping; non-file paths are rejected there
+    int available = 0;
+    const char* contents = getContentsPointer(path, &available, offset);
+    if (contents == nullptr)
         return -1;
 
-    //locate the descriptor
+    //clamp so we don't read past EOF, then copy straight out of the mapping
+    if (length > available)
+        length = available;
+    if (length <= 0)
+        return 0;
+    memcpy(buffer, contents, length);
+    return length;
+}
+
+// returns a pointer to the file's contents from 'offset' on, straight from the mapping of the WAD, and stores
+// how many bytes are there in *length; nullptr for non-file paths. Nothing is copied. The pointer stays valid
+// until the next createDirectory, createFile or writeToFile, which remap the file.
+const char* Wad::getContentsPointer(const std::string& path, int* length, int offset) {
+    //reject non-file paths
     auto iter = fileMap.find(path);
+    if (iter == fileMap.end() || iter->second->length == 0 || fileData == nullptr)
+        return nullptr;
     DescriptorObject* desc = iter->second;
 
-    //compute starting position and total size
-    int startPos = desc->offset + offset;
-    int totalSize = desc->length;
-
-    //seek to the requested byte
-    currentFile.seekg(startPos, std::ios::beg);
-
     //if offset is beyond EOF, nothing to read
-    if (offset > totalSize)
-        return 0;
-
-    //clamp so we don't read past EOF
-    int available = totalSize - offset;
-    if (length > available)
-        length = available;
-
-    //read into buffer and return actual bytes read
-    currentFile.read(buffer, length);
-    return static_cast<int>(currentFile.gcount());
+    *length = 0;
+    if (offset < 0 || static_cast<uint32_t>(offset) >= desc->length)
+        return fileData;
+
+    //clamp to the file as well, in case a descriptor points past its end
+    size_t startPos = static_cast<size_t>(desc->offset) + offset;
+    if (startPos >= fileSize)
+        return fileData;
+    *length = static_cast<int>(std::min<size_t>(desc->length - offset, fileSize - startPos));
+    return fileData + startPos;
 }
 
 int Wad::getDirectory(const string &path, vector<string> *directory) {
@@ -330,6 +380,9 @@ void Wad::createDirectory(const string& path)
     numberOfDescriptors += 2;
     currentFile.seekp(4, ios::beg);
     currentFile.write(reinterpret_cast<char*>(&numberOfDescriptors), 4);
+
+    // The file grew, so map it again
+    mapFile();
 }
 
 void Wad::createFile(const string &path)
@@ -465,6 +518,9 @@ void Wad::createFile(const string &path)
     numberOfDescriptors++;
     currentFile.seekp(4, ios::beg);
     currentFile.write(reinterpret_cast<char*>(&numberOfDescriptors), 4);
+
+    // The file grew, so map it again
+    mapFile();
 }
 
 int Wad::writeToFile(const string& path, const char* buffer, int length, int offset)
@@ -542,8 +598,9 @@ int Wad::writeToFile(const string& path, const char* buffer, int length, int off
     currentFile.seekp(8, ios::beg);
     currentFile.write(reinterpret_cast<char*>(&descriptorOffset), 4);
 
-    // Make sure everything is saved to disk
+    // Make sure everything is saved to disk, and map the grown file again
     currentFile.flush();
+    mapFile();
 
     return maxWritableBytes;
 }
@@ -32,6 +32,8 @@ public:
 
     string wadPath;
     fstream currentFile;
+    const char* fileData;       // read-only mapping of the whole WAD file; contents are served from here
+    size_t fileSize;
     char magic[5];
     uint32_t numberOfDescriptors;
     uint32_t descriptorOffset;
@@ -40,6 +42,9 @@ public:
 
 public:
     Wad(const string& path);
+    Wad(const Wad&) = delete;
+    Wad& operator=(const Wad&) = delete;
+    ~Wad();
     static Wad* loadWad(const string& path);
 
     string getMagic();
@@ -47,8 +52,12 @@ public:
     bool isDirectory(const string& path);
     int getSize(const string& path);
     int getContents(const std::string& path, char* buffer, int length, int offset = 0);
+    const char* getContentsPointer(const std::string& path, int* length, int offset = 0);
     int getDirectory(const string& path, vector<string>* directory);
     void createDirectory(const string& path);
     void createFile(const string& path);
     int writeToFile(const std::string& path, const char* buffer, int length, int offset = 0);
+
+private:
+    void mapFile();
 };